@@ -0,0 +1,226 @@
+#include "Aperture.h"
+#include "HostRaysLanes.h"
+#include "Bitmap.h"
+#include "HashBytes.h"
+
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+std::string ws2s(const std::wstring& s);
+
+static constexpr float APERTURE_PI = 3.14159265358979323846f;
+
+void ApertureShape::ReadFromNode(pugi::xml_node a_apertureNode)
+{
+  type = APERTURE_DISC;
+  if(a_apertureNode == nullptr)
+    return;
+
+  rotation = a_apertureNode.attribute(L"rotation").as_float()*(APERTURE_PI/180.0f);
+
+  if(a_apertureNode.attribute(L"mask") != nullptr)
+  {
+    const std::string path = ws2s(a_apertureNode.attribute(L"mask").as_string());
+    int w = 0, h = 0;
+    std::vector<unsigned int> pixels = LoadBMP(path.c_str(), &w, &h);
+    if(pixels.empty())
+    {
+      std::cout << "[ApertureShape::ReadFromNode]: can't load mask " << path.c_str() << ", use disc aperture" << std::endl;
+      return;
+    }
+
+    m_maskW = w;
+    m_maskH = h;
+    m_mask.resize(pixels.size());
+    for(size_t i=0;i<pixels.size();i++)
+    {
+      const float r = float((pixels[i] & 0x00FF0000) >> 16);
+      const float g = float((pixels[i] & 0x0000FF00) >> 8);
+      const float b = float((pixels[i] & 0x000000FF));
+      m_mask[i]     = (r + g + b)*(1.0f/(3.0f*255.0f)); // channel order does not matter for gray mask
+    }
+
+    BuildAliasTable(m_mask);
+    if(m_prob.empty())
+    {
+      std::cout << "[ApertureShape::ReadFromNode]: mask " << path.c_str() << " is black, use disc aperture" << std::endl;
+      return;
+    }
+    type = APERTURE_MASK;
+  }
+  else if(a_apertureNode.attribute(L"blades").as_int() >= 3)
+  {
+    blades = a_apertureNode.attribute(L"blades").as_int();
+    BuildPolygon();
+    type = APERTURE_POLYGON;
+  }
+}
+
+void ApertureShape::BuildPolygon()
+{
+  m_vertX.resize(blades+1);
+  m_vertY.resize(blades+1);
+  for(int k=0;k<=blades;k++)
+  {
+    const float phi = rotation + 2.0f*APERTURE_PI*float(k % blades)/float(blades);
+    m_vertX[k] = std::cos(phi);
+    m_vertY[k] = std::sin(phi);
+  }
+  m_apothem = std::cos(APERTURE_PI/float(blades));
+}
+
+void ApertureShape::BuildAliasTable(const std::vector<float>& a_weights)
+{
+  const size_t N = a_weights.size();
+  double summ = 0.0;
+  for(auto w : a_weights)
+    summ += double(w);
+
+  m_prob.clear();
+  m_alias.clear();
+  if(summ <= 0.0)
+    return;
+
+  // Vose's method
+  //
+  std::vector<double>   scaled(N);
+  std::vector<uint32_t> small, large;
+  small.reserve(N);
+  large.reserve(N);
+  for(size_t i=0;i<N;i++)
+  {
+    scaled[i] = double(a_weights[i])*double(N)/summ;
+    if(scaled[i] < 1.0)
+      small.push_back(uint32_t(i));
+    else
+      large.push_back(uint32_t(i));
+  }
+
+  m_prob.resize(N);
+  m_alias.resize(N);
+  while(!small.empty() && !large.empty())
+  {
+    const uint32_t s = small.back(); small.pop_back();
+    const uint32_t l = large.back(); large.pop_back();
+    m_prob [s] = float(scaled[s]);
+    m_alias[s] = l;
+    scaled[l]  = (scaled[l] + scaled[s]) - 1.0;
+    if(scaled[l] < 1.0)
+      small.push_back(l);
+    else
+      large.push_back(l);
+  }
+
+  for(auto i : large) { m_prob[i] = 1.0f; m_alias[i] = i; }
+  for(auto i : small) { m_prob[i] = 1.0f; m_alias[i] = i; } // only due to round-off
+}
+
+void ApertureShape::SampleLanes(const float* a_u, const float* a_v, const float* a_w, float* out_x, float* out_y) const
+{
+  switch(type)
+  {
+    case APERTURE_POLYGON:
+    {
+      // 'blades' equal triangles (center, vert[k], vert[k+1]); 'u' selects triangle and is reused inside it
+      //
+      const float  fBlades = float(blades);
+      const float* vx      = m_vertX.data();
+      const float* vy      = m_vertY.data();
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float t  = a_u[i]*fBlades;
+        const int   k  = std::min(int(t), blades-1);
+        const float s  = std::sqrt(t - float(k));
+        const float b1 = s*(1.0f - a_v[i]);
+        const float b2 = s*a_v[i];
+        out_x[i] = b1*vx[k] + b2*vx[k+1];
+        out_y[i] = b1*vy[k] + b2*vy[k+1];
+      }
+    }
+    break;
+
+    case APERTURE_MASK:
+    {
+      // alias table selects pixel with 'u'; jitter inside pixel is 'w' along x and 'v' along y
+      //
+      const uint32_t pixNum = uint32_t(m_prob.size());
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const double   t   = double(a_u[i])*double(pixNum);
+        const uint32_t idx = std::min(uint32_t(t), pixNum-1);
+        const float    f   = float(t - double(idx));
+        const uint32_t pix = (f < m_prob[idx]) ? idx : m_alias[idx];
+        const uint32_t px  = pix % uint32_t(m_maskW);
+        const uint32_t py  = pix / uint32_t(m_maskW);
+        out_x[i] = 2.0f*(float(px) + a_w[i])/float(m_maskW) - 1.0f;
+        out_y[i] = 2.0f*(float(py) + a_v[i])/float(m_maskH) - 1.0f;
+      }
+    }
+    break;
+
+    default:
+    {
+      alignas(32) float cx[RAY_LANES], cy[RAY_LANES];
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        cx[i] = a_u[i] - 0.5f;
+        cy[i] = a_v[i] - 0.5f;
+      }
+      MapSamplesToDiscLanes(cx, cy, out_x, out_y);
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        out_x[i] *= 2.0f;
+        out_y[i] *= 2.0f;
+      }
+    }
+    break;
+  };
+}
+
+bool ApertureShape::NeedsJitter() const { return type == APERTURE_MASK; }
+
+bool ApertureShape::IsOpen(float a_x, float a_y) const
+{
+  switch(type)
+  {
+    case APERTURE_POLYGON:
+    {
+      float phi = std::fmod(std::atan2(a_y, a_x) - rotation, 2.0f*APERTURE_PI); // 'rotation' is not normalized, any angle in XML is valid
+      if(phi < 0.0f)
+        phi += 2.0f*APERTURE_PI;
+      const int   k  = std::min(int(phi*float(blades)/(2.0f*APERTURE_PI)), blades-1);
+      const float mx = 0.5f*(m_vertX[k] + m_vertX[k+1]); // edge middle; its length is apothem
+      const float my = 0.5f*(m_vertY[k] + m_vertY[k+1]); //
+      return (a_x*mx + a_y*my) <= m_apothem*m_apothem;
+    }
+
+    case APERTURE_MASK:
+    {
+      const int px = int(0.5f*(a_x + 1.0f)*float(m_maskW));
+      const int py = int(0.5f*(a_y + 1.0f)*float(m_maskH));
+      if(px < 0 || py < 0 || px >= m_maskW || py >= m_maskH)
+        return false;
+      return m_mask[py*m_maskW + px] >= 0.5f;
+    }
+
+    default:
+      return (a_x*a_x + a_y*a_y) <= 1.0f;
+  };
+}
+
+uint64_t ApertureShape::Hash(uint64_t a_seed) const
+{
+  const int typeId = int(type);
+  uint64_t hash = a_seed;
+  hash = HashBytes(&typeId,   sizeof(typeId),   hash);
+  hash = HashBytes(&blades,   sizeof(blades),   hash);
+  hash = HashBytes(&rotation, sizeof(rotation), hash);
+  hash = HashBytes(&m_maskW,  sizeof(m_maskW),  hash);
+  hash = HashBytes(&m_maskH,  sizeof(m_maskH),  hash);
+  if(!m_mask.empty())
+    hash = HashBytes(m_mask.data(), m_mask.size()*sizeof(float), hash);
+  return hash;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+
+/**
+  \brief Aperture shape read from <aperture> node of camera. Examples:
+
+    <aperture blades="6" rotation="15" />          <!-- regular hexagon, rotated by 15 degrees -->
+    <aperture mask="/home/.../my_bokeh_mask.bmp" /> <!-- 24 bit grayscale mask, white is open -->
+
+  Without this node aperture is a disc. All sampling is constant time per sample: polygon is split into
+  equal triangles and mask is sampled with alias table, so no samples are rejected.
+*/
+struct ApertureShape
+{
+  enum TYPE { APERTURE_DISC = 0, APERTURE_POLYGON = 1, APERTURE_MASK = 2 };
+
+  void ReadFromNode(pugi::xml_node a_apertureNode);
+
+  /**
+  \brief map lane group of [0,1)^2 samples to aperture
+  \param a_u    - in  first  sample of RAY_LANES size
+  \param a_v    - in  second sample of RAY_LANES size
+  \param a_w    - in  third  sample of RAY_LANES size, jitter along x inside mask pixel; used only by APERTURE_MASK (see NeedsJitter)
+  \param out_x  - out x on aperture, [-1,1]
+  \param out_y  - out y on aperture, [-1,1]
+
+    Points are distributed proportionally to aperture transmission; unit circle is the full aperture radius.
+    APERTURE_DISC gives exactly the same points as 2*MapSamplesToDisc(u - 0.5, v - 0.5).
+  */
+  void SampleLanes(const float* a_u, const float* a_v, const float* a_w, float* out_x, float* out_y) const;
+
+  /**
+  \brief true if SampleLanes reads 'a_w': 'u' picks a pixel of alias table, and for big masks too few bits of it are left for jitter
+  */
+  bool NeedsJitter() const;
+
+  /**
+  \brief test that point in [-1,1]^2 passes through aperture; used for aperture stop of real lens.
+    Mask pixels darker than 50% are treated as closed.
+  */
+  bool IsOpen(float a_x, float a_y) const;
+
+  /**
+  \brief FNV-1a hash of shape and mask, continued from 'a_seed'; used as a part of cache keys
+  */
+  uint64_t Hash(uint64_t a_seed) const;
+
+  TYPE  type     = APERTURE_DISC;
+  int   blades   = 0;
+  float rotation = 0.0f; ///<! in radians
+
+protected:
+
+  void BuildPolygon();
+  void BuildAliasTable(const std::vector<float>& a_weights);
+
+  std::vector<float> m_vertX;     ///<! polygon vertices on unit circle, blades+1 with the first one repeated at the end
+  std::vector<float> m_vertY;     ///<!
+  float              m_apothem = 1.0f;
+
+  std::vector<float>    m_mask;   ///<! grayscale mask in [0,1], bottom row first as LoadBMP returns it
+  std::vector<float>    m_prob;   ///<! alias table
+  std::vector<uint32_t> m_alias;  ///<!
+  int m_maskW = 0;
+  int m_maskH = 0;
+};
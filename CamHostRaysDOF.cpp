@@ -17,39 +17,31 @@
 #include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
 #include "../HydraAPI/hydra_api/HydraAPI.h"
 
-class SimpleDOF : public IHostRaysAPI
+#include "HostRaysBase.h"
+#include "HostKernels.h"
+#include "Aperture.h"
+#include "RaysRecord.h"
+
+/**
+  \brief Pinhole camera of Hydra projection matrix (cpu_plugin="1") with optional thin lens depth of field.
+         Ray mapping is a lane-group functor in HostKernels.cpp on top of shared GenerateRays.
+*/
+class SimpleDOF : public HostRaysBase
 {
 public:
-  SimpleDOF() { hr_qmc::init(table); m_globalCounter = 0; }
-  
-  void SetParameters(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText) override
-  {
-    m_fwidth  = float(a_width);
-    m_fheight = float(a_height);
-    memcpy(&m_projInv, a_projInvMatrix, sizeof(float4x4));
-
-    m_doc.load_string(a_camNodeText);
-    ReadParamsFromNode(m_doc.child(L"camera"));
-  }
-
-  void ReadParamsFromNode(pugi::xml_node a_camNode);
+  SimpleDOF(const HostKernels* a_kernels) : HostRaysBase(a_kernels, "SimpleDOF", "") { } // no image by default, <output image="..."/> enables it
 
+  void ReadParamsFromNode(pugi::xml_node a_camNode) override;
   void MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId) override;
-  void AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId) override;
-  void FinishRendering() override { std::cout << "SimpleDOF::FinishRendering is called" << std::endl; }
 
-  pugi::xml_document m_doc;
+  void CalcFilmBasis();
 
-  unsigned int table[hr_qmc::QRNG_DIMENSIONS][hr_qmc::QRNG_RESOLUTION];
-  unsigned int m_globalCounter = 0;
-
-  float m_fwidth  = 1024.0f;
-  float m_fheight = 1024.0f;
-  float4x4 m_projInv;
+  FilmBasis m_film;
 
   float FOCAL_PLANE_DIST = 10.0f;
   float DOF_LENS_RADIUS  = 0.0f;
   bool  DOF_IS_ENABLED = false;
+  ApertureShape m_aperture;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -57,8 +49,14 @@ public:
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+std::string ws2s(const std::wstring& s);
+
 void SimpleDOF::ReadParamsFromNode(pugi::xml_node a_camNode)
 {
+  CalcFilmBasis();
+  m_aperture.ReadFromNode(a_camNode.child(L"aperture"));
+
+  DOF_IS_ENABLED = false;
   if (a_camNode.child(L"enable_dof").text().empty())
     return;
 
@@ -87,89 +85,55 @@ void SimpleDOF::ReadParamsFromNode(pugi::xml_node a_camNode)
     }
     FOCAL_PLANE_DIST = length(camPos - camLookAt);
   }
-  else
-    DOF_IS_ENABLED = false;
 }
 
-static inline int myPackXY1616(int x, int y) { return (y << 16) | (x & 0x0000FFFF); }
-
-void SimpleDOF::MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId)
+void SimpleDOF::CalcFilmBasis()
 {
-  #pragma omp parallel for
-  for(int i=0;i<in_blockSize;i++)
+  // EyeRayDir: ndc = ( 2*(x + 0.5)/w - 1, -2*(y + 0.5)/h + 1, 0, 1 ); pos = m_projInv*ndc
+  //
+  const float ndcX0 = 1.0f/m_fwidth - 1.0f;
+  const float ndcY0 = 1.0f - 1.0f/m_fheight;
+  const float ndcDX = 2.0f/m_fwidth;
+  const float ndcDY = -2.0f/m_fheight;
+
+  const float4 rows[4] = {m_projInv.row[0], m_projInv.row[1], m_projInv.row[2], m_projInv.row[3]};
+  for(int k=0;k<4;k++)
   {
-    const float rndX = hr_qmc::rndFloat(m_globalCounter+i, 0, table[0]);
-    const float rndY = hr_qmc::rndFloat(m_globalCounter+i, 1, table[0]);
-    
-    const float x    = m_fwidth*rndX; 
-    const float y    = m_fheight*rndY;
-
-    float3 ray_pos = float3(0,0,0);
-    float3 ray_dir = EyeRayDir(x, y, m_fwidth, m_fheight, m_projInv);
-
-    if (DOF_IS_ENABLED) // dof is enabled
-    {
-      const float lenzX = hr_qmc::rndFloat(m_globalCounter+i, 2, table[0]);
-      const float lenzY = hr_qmc::rndFloat(m_globalCounter+i, 3, table[0]);
-
-      const float tFocus         = FOCAL_PLANE_DIST / (-ray_dir.z);
-      const float3 focusPosition = ray_pos + ray_dir*tFocus;
-      const float2 xy            = DOF_LENS_RADIUS*2.0f*MapSamplesToDisc(float2(lenzX - 0.5f, lenzY - 0.5f));
-      ray_pos.x += xy.x;
-      ray_pos.y += xy.y;
-  
-      ray_dir = normalize(focusPosition - ray_pos);
-    }
-
-
-    RayPart1 p1;
-    p1.origin[0]   = ray_pos.x;
-    p1.origin[1]   = ray_pos.y;
-    p1.origin[2]   = ray_pos.z;
-    p1.xyPosPacked = myPackXY1616(int(x), int(y));
-   
-    RayPart2 p2;
-    p2.direction[0] = ray_dir.x;
-    p2.direction[1] = ray_dir.y;
-    p2.direction[2] = ray_dir.z;
-    p2.dummy        = 0.0f;
-    
-    out_rayPosAndNear[i] = p1;
-    out_rayDirAndFar [i] = p2;
+    m_film.origin[k] = rows[k].x*ndcX0 + rows[k].y*ndcY0 + rows[k].w;
+    m_film.dx[k]     = rows[k].x*ndcDX;
+    m_film.dy[k]     = rows[k].y*ndcDY;
   }
+}
+
+void SimpleDOF::MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId)
+{
+  const int putID = BeginBlock(in_blockSize, passId);
+
+  DOFRaysArgs args;
+  args.qmcTable       = &table[0][0];
+  args.qmcBytes       = &m_qmcBytes;
+  args.qmcStart       = unsigned(m_globalCounter);
+  args.fwidth         = m_fwidth;
+  args.fheight        = m_fheight;
+  args.film           = m_film;
+  args.dofEnabled     = DOF_IS_ENABLED;
+  args.focalPlaneDist = FOCAL_PLANE_DIST;
+  args.lensRadius     = DOF_LENS_RADIUS;
+  args.aperture       = &m_aperture;
+  args.crop           = &m_crop;
+  m_kernels->MakeRaysDOF(args, out_rayPosAndNear, out_rayDirAndFar, m_pipeline[putID].data(), int(in_blockSize));
 
   //std::this_thread::sleep_for(std::chrono::milliseconds(50)); // test big delay
 
-  m_globalCounter += unsigned(in_blockSize);
+  EndBlock(out_rayPosAndNear, out_rayDirAndFar, in_blockSize, putID);
 } 
 
-void SimpleDOF::AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId)
-{
-  float4*       out_color = (float4*)out_color4f;
-  const float4* colors    = (const float4*)colors4f;
-  
-  for (int i = 0; i < in_blockSize; i++)
-  {
-    const auto color = colors[i];
-    const uint32_t packedIndex = as_int(color.w);
-    const int x      = (packedIndex & 0x0000FFFF);         ///<! extract x position from color.w
-    const int y      = (packedIndex & 0xFFFF0000) >> 16;   ///<! extract y position from color.w
-    const int offset = y*a_width + x;
-
-    if (x >= 0 && y >= 0 && x < a_width && y < a_height)
-    {
-      out_color[offset].x += color.x;
-      out_color[offset].y += color.y;
-      out_color[offset].z += color.z;
-    }
-  }
-}
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-IHostRaysAPI* CreateTableLens();
+HostRaysBase* CreateTableLens(const HostKernels* a_kernels);
+HostRaysBase* CreateProjectionCamera(const HostKernels* a_kernels, int a_pluginId);
 
 IHostRaysAPI* MakeHostRaysEmitter(int a_pluginId) ///<! you replace this function or make your own ... the example will be provided
 {
@@ -177,10 +141,15 @@ IHostRaysAPI* MakeHostRaysEmitter(int a_pluginId) ///<! you replace this functio
     return nullptr;
 
   std::cout << "[MakeHostRaysEmitter]: create plugin #" << a_pluginId << std::endl;
+  const HostKernels* pKernels = SelectHostKernels(); // by CPUID; camera node may override it with <host_isa>
+  HostRaysBase* pImpl = nullptr;
   if(a_pluginId == 2)
-    return CreateTableLens();
+    pImpl = CreateTableLens(pKernels);
+  else if(a_pluginId >= 3 && a_pluginId <= 5)
+    pImpl = CreateProjectionCamera(pKernels, a_pluginId);
   else
-    return new SimpleDOF();
+    pImpl = new SimpleDOF(pKernels);
+  return MakeRaysRecorder(pImpl, pImpl);
 }
 
 void DeleteRaysEmitter(IHostRaysAPI* pObject) { delete pObject; }
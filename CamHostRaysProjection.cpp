@@ -0,0 +1,75 @@
+#include "CamHostPluginAPI.h"
+#include <iostream>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "../HydraCore/hydra_drv/cglobals.h"
+#include "../HydraAPI/hydra_api/HydraAPI.h"
+
+#include "HostRaysBase.h"
+#include "HostKernels.h"
+
+/**
+  \brief Cameras without lens: equirectangular panorama (cpu_plugin="3"), equidistant fisheye (cpu_plugin="4") and orthographic (cpu_plugin="5").
+         Ray mapping of each one is a lane-group functor in HostKernels.cpp on top of shared GenerateRays.
+*/
+class ProjectionCamera : public HostRaysBase
+{
+public:
+  ProjectionCamera(const HostKernels* a_kernels, PROJECTION_TYPE a_type) : HostRaysBase(a_kernels, "ProjectionCamera", "z_projection_image.bmp"), m_type(a_type) { }
+
+  void ReadParamsFromNode(pugi::xml_node a_camNode) override;
+  void MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId) override;
+
+  PROJECTION_TYPE m_type;
+  float m_fisheyeFov = 180.0f;  ///<! in degrees
+  float m_orthoSize  = 1.0f;    ///<! width of orthographic view, height is taken by aspect
+};
+
+void ProjectionCamera::ReadParamsFromNode(pugi::xml_node a_camNode)
+{
+  m_fisheyeFov = 180.0f;
+  m_orthoSize  = 1.0f;
+  if(!a_camNode.child(L"fisheye_fov").text().empty())
+    m_fisheyeFov = a_camNode.child(L"fisheye_fov").text().as_float();
+  if(!a_camNode.child(L"ortho_size").text().empty())
+    m_orthoSize = a_camNode.child(L"ortho_size").text().as_float();
+
+  if(m_type == PROJECTION_FISHEYE && (m_fisheyeFov <= 0.0f || m_fisheyeFov > 360.0f))
+  {
+    std::cout << "[ProjectionCamera::ReadParamsFromNode]: bad fisheye_fov = " << m_fisheyeFov << ", 180 is used" << std::endl;
+    m_fisheyeFov = 180.0f;
+  }
+}
+
+void ProjectionCamera::MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId)
+{
+  const int putID = BeginBlock(in_blockSize, passId);
+
+  ProjectionRaysArgs args;
+  args.qmcTable   = &table[0][0];
+  args.qmcBytes   = &m_qmcBytes;
+  args.qmcStart   = unsigned(m_globalCounter);
+  args.fwidth     = m_fwidth;
+  args.fheight    = m_fheight;
+  args.type       = m_type;
+  args.fisheyeFov = m_fisheyeFov*3.141592654f/180.0f;
+  args.orthoSizeX = m_orthoSize;
+  args.orthoSizeY = m_orthoSize*m_fheight/m_fwidth;
+  args.crop       = &m_crop;
+  m_kernels->MakeRaysProjection(args, out_rayPosAndNear, out_rayDirAndFar, m_pipeline[putID].data(), int(in_blockSize));
+
+  EndBlock(out_rayPosAndNear, out_rayDirAndFar, in_blockSize, putID);
+}
+
+HostRaysBase* CreateProjectionCamera(const HostKernels* a_kernels, int a_pluginId)
+{
+  switch(a_pluginId)
+  {
+    case 4:  return new ProjectionCamera(a_kernels, PROJECTION_FISHEYE);
+    case 5:  return new ProjectionCamera(a_kernels, PROJECTION_ORTHO);
+    default: return new ProjectionCamera(a_kernels, PROJECTION_EQUIRECT);
+  };
+}
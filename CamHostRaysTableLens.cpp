@@ -15,58 +15,36 @@
 #include "../HydraAPI/hydra_api/HydraAPI.h"
 
 #include "Bitmap.h"
+#include "Aperture.h"
+#include "HostRaysBase.h"
+#include "HostKernels.h"
+#include "LensTrace.h"
+#include "LensValidation.h"
 
-struct PipeThrough
-{
-  float cosPower4      = 1.0f;
-  uint32_t packedIndex = 0;
-};
-
-class TableLens : public IHostRaysAPI
+class TableLens : public HostRaysBase
 {
 public:
-  TableLens() { hr_qmc::init(table); m_globalCounter = 0; }
+  TableLens(const HostKernels* a_kernels) : HostRaysBase(a_kernels, "TableLens", "z_alex_image.bmp") { }
   
   void SetParameters(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText) override
   {
-    m_width   = a_width;
-    m_height  = a_height;
-    m_fwidth  = float(a_width);
-    m_fheight = float(a_height);
-    m_aspect  = m_fheight / m_fwidth;
+    m_aspect = float(a_height) / float(a_width);
     CalcPhysSize();
-    memcpy(&m_projInv, a_projInvMatrix, sizeof(float4x4));
-
-    m_doc.load_string(a_camNodeText);
-    ReadParamsFromNode(m_doc.child(L"camera"));
+    HostRaysBase::SetParameters(a_width, a_height, a_projInvMatrix, a_camNodeText);
     RunTestRays();
   }
 
-  void ReadParamsFromNode(pugi::xml_node a_camNode);
+  void ReadParamsFromNode(pugi::xml_node a_camNode) override;
   void RunTestRays();
 
   void MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId) override;
-  void AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId) override;
-  void FinishRendering() override;
-
-  pugi::xml_document m_doc;
-
-  unsigned int table[hr_qmc::QRNG_DIMENSIONS][hr_qmc::QRNG_RESOLUTION];
-  unsigned int m_globalCounter = 0;
 
-  float m_fwidth  = 1024.0f;
-  float m_fheight = 1024.0f;
-  int m_width;
-  int m_height;
   float m_aspect  = 1.0f;
   float2 m_physSize;
-  float4x4 m_projInv;
   float m_diagonal    = 1.0f; // on meter
 
   mutable std::vector<float3> m_debugPos;
   bool m_enableDebug = false;
-  double m_sppDone = 0.0;
-  float* m_lastFbPointer = nullptr;
   //////////////////////////////////////////////////////////////////////////////////////
   //////////////////////////////////////////////////////////////////////////////////////
   
@@ -74,24 +52,16 @@ public:
   bool TraceLensesFromFilm(const float3 inRayPos, const float3 inRayDir, 
                            float3* outRayPos, float3* outRayDir) const;
 
-  bool  IntersectSphericalElement(float radius, float zCenter, const float3 rayPos, const float3 rayDir, 
-                                  float *t, float3 *n) const;
-
-  std::vector<PipeThrough> m_pipeline[HOST_RAYS_PIPELINE_LENGTH];
-
-  struct LensElementInterface {
-    float curvatureRadius;
-    float thickness;
-    float eta;
-    float apertureRadius;
-  };
-
   struct LensElementInterfaceWithId {
     LensElementInterface lensElement;
     int id;
   };
   
   std::vector<LensElementInterface> lines;
+  ApertureShape m_aperture; ///<! shape of aperture stop (line with zero curvature)
+  ThickLens     m_thickLens = {}; ///<! paraxial model of 'lines'
+  bool          m_preview = false; ///<! generate rays with 'm_thickLens' instead of tracing 'lines'
+  float         m_focusDistance = 0.0f; ///<! from sensor; if set, distance from sensor to rear element (lines[0].thickness) is solved for it
 
   inline float LensRearZ()      const { return lines[0].thickness; }
   inline float LensRearRadius() const { return lines[0].apertureRadius; }
@@ -113,6 +83,8 @@ std::string  ws2s(const std::wstring& s);
 
 void TableLens::ReadParamsFromNode(pugi::xml_node a_camNode)
 {
+  m_aperture.ReadFromNode(a_camNode.child(L"aperture"));
+
   auto opticalSys = a_camNode.child(L"optical_system");
   if(opticalSys == nullptr)
   {
@@ -162,170 +134,93 @@ void TableLens::ReadParamsFromNode(pugi::xml_node a_camNode)
   lines.resize(ids.size());
   for(size_t i=0;i<ids.size(); i++)
     lines[i] = ids[i].lensElement;
-}
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-static constexpr float MachineEpsilon = std::numeric_limits<float>::epsilon();
-
-static inline bool Quadratic(float A, float B, float C, float *t0, float *t1) {
-  // Find quadratic discriminant
-  double discrim = (double)B * (double)B - 4. * (double)A * (double)C;
-  if (discrim < 0.) 
-    return false;
-  double rootDiscrim = std::sqrt(discrim);
-  float floatRootDiscrim   = rootDiscrim;
-  //float floatRootDiscrimErr = MachineEpsilon * rootDiscrim;
-  // Compute quadratic _t_ values
-  float q;
-  if ((float)B < 0)
-      q = -.5 * (B - floatRootDiscrim);
-  else
-      q = -.5 * (B + floatRootDiscrim);
-  *t0 = q / A;
-  *t1 = C / q;
-  if ((float)*t0 > (float)*t1) 
-    std::swap(*t0, *t1);
-  return true;
-}
-
-static inline bool Refract(const float3 wi, const float3 n, float eta, float3 *wt) {
-  // Compute $\cos \theta_\roman{t}$ using Snell's law
-  float cosThetaI  = dot(n, wi);
-  float sin2ThetaI = std::max(float(0), float(1.0f - cosThetaI * cosThetaI));
-  float sin2ThetaT = eta * eta * sin2ThetaI;
-  // Handle total internal reflection for transmission
-  if (sin2ThetaT >= 1) return false;
-  float cosThetaT = std::sqrt(1 - sin2ThetaT);
-  *wt = eta * -wi + (eta * cosThetaI - cosThetaT) * n;
-  return true;
+  m_focusDistance = scale*opticalSys.attribute(L"focus_distance").as_float(0.0f); // in units of lens data as lines above
+  m_preview       = opticalSys.attribute(L"preview").as_bool();
 }
 
-
-static inline float3 faceforward(const float3 n, const float3 v) { return (dot(n, v) < 0.f) ? -n : n; }
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool TableLens::IntersectSphericalElement(float radius, float zCenter, const float3 rayPos, const float3 rayDir, 
-                                          float *t, float3 *n) const
-{
-  // Compute _t0_ and _t1_ for ray--element intersection
-  const float3 o = rayPos - float3(0, 0, zCenter);
-  const float  A = rayDir.x * rayDir.x + rayDir.y * rayDir.y + rayDir.z * rayDir.z;
-  const float  B = 2 * (rayDir.x * o.x + rayDir.y * o.y + rayDir.z * o.z);
-  const float  C = o.x * o.x + o.y * o.y + o.z * o.z - radius * radius;
-  float  t0, t1;
-  if (!Quadratic(A, B, C, &t0, &t1)) 
-    return false;
-  
-  // Select intersection $t$ based on ray direction and element curvature
-  bool useCloserT = (rayDir.z > 0.0f) ^ (radius < 0.0);
-  *t = useCloserT ? std::min(t0, t1) : std::max(t0, t1);
-  if (*t < 0.0f) 
-    return false;
-  
-  // Compute surface normal of element at ray intersection point
-  *n = normalize(o + (*t)*rayDir);
-  *n = faceforward(*n, -1.0f*rayDir);
-  return true;
-}
-
 bool TableLens::TraceLensesFromFilm(const float3 inRayPos, const float3 inRayDir, 
                                     float3* outRayPos, float3* outRayDir) const
 {
-  float elementZ = 0;
-  // Transform _rCamera_ from camera to lens system space
-  // 
-  float3 rayPosLens = float3(inRayPos.x, inRayPos.y, -inRayPos.z);
-  float3 rayDirLens = float3(inRayDir.x, inRayDir.y, -inRayDir.z);
+  const kmath::float3 pos = kmath::make_float3(inRayPos.x, inRayPos.y, inRayPos.z);
+  const kmath::float3 dir = kmath::make_float3(inRayDir.x, inRayDir.y, inRayDir.z);
+  kmath::float3 resPos, resDir;
+
+  std::vector<kmath::float3> hits(m_enableDebug ? lines.size() : 0);
+  int hitsNum = 0;
+  const bool res = ::TraceLensesFromFilm(lines.data(), int(lines.size()), &m_aperture, pos, dir, &resPos, &resDir,
+                                         m_enableDebug ? hits.data() : nullptr, &hitsNum);
+  for(int i=0;i<hitsNum;i++)
+    m_debugPos.push_back(float3(hits[i].x, hits[i].y, hits[i].z));
+
+  (*outRayPos) = float3(resPos.x, resPos.y, resPos.z);
+  (*outRayDir) = float3(resDir.x, resDir.y, resDir.z);
+  return res;
+}
 
-  for(int i=0; i<lines.size(); i++)
+void TableLens::RunTestRays()
+{ 
+  if(lines.empty())
   {
-    const LensElementInterface& element = lines[i];                                  
-    // Update ray from film accounting for interaction with _element_
-    elementZ -= element.thickness;
-    
-    // Compute intersection of ray with lens element
-    float t;
-    float3 n;
-    bool isStop = (element.curvatureRadius == 0.0f);
-    if (isStop) 
-    {
-      // The refracted ray computed in the previous lens element
-      // interface may be pointed towards film plane(+z) in some
-      // extreme situations; in such cases, 't' becomes negative.
-      if (rayDirLens.z >= 0.0f) 
-        return false;
-      t = (elementZ - rayPosLens.z) / rayDirLens.z;
-    } 
-    else 
-    {
-      const float radius  = element.curvatureRadius;
-      const float zCenter = elementZ + element.curvatureRadius;
-      if (!IntersectSphericalElement(radius, zCenter, rayPosLens, rayDirLens, &t, &n))
-        return false;
-    }
+    std::cout << "[TableLens::RunTestRays]: optical_system has no lines, all rays are dead" << std::endl;
+    m_thickLens = ThickLens();
+    m_preview   = false;
+    return;
+  }
 
-    // Test intersection point against element aperture
-    const float3 pHit = rayPosLens + t*rayDirLens;
-    if(m_enableDebug)
-      m_debugPos.push_back(pHit);
-    const float r2    = pHit.x * pHit.x + pHit.y * pHit.y;
-    if (r2 > element.apertureRadius * element.apertureRadius) 
-      return false;
-    
-    rayPosLens = pHit;
-    // Update ray path for from-scene element interface interaction
-    if (!isStop) 
+  // batch of real rays from several points of sensor; result is cached by prescription, aperture, sensor size and focus distance, so repeated frames pay nothing and print nothing
+  //
+  bool fromCache = false;
+  const LensValidation check = ValidateLensSystem(lines, m_aperture, m_physSize.x, m_physSize.y, m_focusDistance, &fromCache);
+
+  // the same lens was reported when it was validated, so repeated frames are quiet
+  //
+  const bool report = !fromCache;
+
+  if(m_focusDistance > 0.0f)
+  {
+    if(check.focusSolved)
     {
-      float3 wt;
-      float etaI = lines[i+0].eta;                                                      
-      float etaT = (i == lines.size()-1) ? 1.0f : lines[i+1].eta;
-      if(etaT == 0.0f)
-        etaT = 1.0f;                                                          
-      if (!Refract(normalize((-1.0f)*rayDirLens), n, etaI / etaT, &wt))
-        return false;
-      rayDirLens = wt;
+      if(report)
+        std::cout << "[TableLens::RunTestRays]: focus at " << m_focusDistance << ", sensor to rear element = " << check.rearThickness << " (was " << lines[0].thickness << ")" << std::endl;
+      lines[0].thickness = check.rearThickness;
     }
-
+    else if(report)
+      std::cout << "[TableLens::RunTestRays]: can't focus at " << m_focusDistance << ", lens system has no real image for this distance" << std::endl;
   }
 
-  // Transform _rLens_ from lens system space back to camera space
-  //
-  (*outRayPos) = float3(rayPosLens.x, rayPosLens.y, -rayPosLens.z);
-  (*outRayDir) = float3(rayDirLens.x, rayDirLens.y, -rayDirLens.z);
-  return true;  
-}
+  if(report)
+  {
+    std::cout << "[TableLens::RunTestRays]: transmission from sensor center to corner =";
+    for(int zoneId=0; zoneId<LENS_VALIDATION_ZONES; zoneId++)
+      std::cout << " " << check.transmission[zoneId];
+    std::cout << std::endl;
+
+    if(check.transmission[0] == 0.0f)
+      std::cout << "[TableLens::RunTestRays]: WARNING! no rays pass lens system from sensor center; check 'order', 'scale' and 'semi_diameter'/'aperture_radius' of optical_system" << std::endl;
+    else if(check.transmission[LENS_VALIDATION_ZONES-1] == 0.0f)
+      std::cout << "[TableLens::RunTestRays]: WARNING! sensor corners are fully vignetted; check 'sensor_diagonal' and 'scale' of optical_system" << std::endl;
+  }
 
-void TableLens::RunTestRays()
-{ 
-  // PBRT:
-  //
-  ////float3 rayPos(0,0,1);
-  ////float3 rayDir(0,0,-1);
-  //float3 rayPos(3.5e-5f, 0, 0.999999821f);
-  //float3 rayDir(0,0,-1);
-  //bool res = TraceLensesFromFilm(rayPos, rayDir, &rayPos, &rayDir);
-  //int a = 2;
-
-  float3 ray_pos       = float3(1.0f, 0.0f, 0);
-  const float2 rareSam = float2(0, 0); // 0.125f*m_physSize.x // 7,773602061 // 0.003965f
-
-  const float3 shootTo = float3(rareSam.x, rareSam.y, LensRearZ());
-  float3 ray_dir       = normalize(shootTo - ray_pos);
-  bool rayIsDead       = false;
-  if (!TraceLensesFromFilm(ray_pos, ray_dir, &ray_pos, &ray_dir)) 
+  m_thickLens = CalcThickLens(lines.data(), int(lines.size()));
+  if(!m_thickLens.valid)
   {
-    ray_pos = float3(0,-10000000.0,0.0); // shoot ray under the floor
-    ray_dir = float3(0,-1,0);
-    rayIsDead = true;
+    if(report)
+      std::cout << "[TableLens::RunTestRays]: lens system is afocal, thick lens preview is disabled" << std::endl;
+    m_preview = false;
+    return;
   }
-  else
+
+  if(report)
   {
-    ray_dir = float3(-1,-1,-1)*normalize(ray_dir);
-    ray_pos = float3(-1,-1,-1)*ray_pos;
+    std::cout << "[TableLens::RunTestRays]: focal length = " << m_thickLens.focalLength << std::endl;
+    std::cout << "[TableLens::RunTestRays]: principal planes (rear, front) = (" << m_thickLens.rearPrincipalZ << ", " << m_thickLens.frontPrincipalZ << ")" << std::endl;
+    std::cout << "[TableLens::RunTestRays]: focal points     (rear, front) = (" << m_thickLens.rearFocalZ << ", " << m_thickLens.frontFocalZ << ")" << std::endl;
+    std::cout << "[TableLens::RunTestRays]: entrance pupil z = " << m_thickLens.entrancePupilZ << ", radius = " << m_thickLens.entrancePupilRadius << std::endl;
+    std::cout << "[TableLens::RunTestRays]: exit pupil     z = " << m_thickLens.exitPupilZ     << ", radius = " << m_thickLens.exitPupilRadius     << std::endl;
   }
 
   // Zemax data for thorlabs
@@ -382,128 +277,43 @@ void TableLens::RunTestRays()
 
 void TableLens::MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId)
 {
-  if(m_pipeline[0].size() == 0)
+  const int putID = BeginBlock(in_blockSize, passId);
+
+  if(m_preview && m_thickLens.valid)
   {
-    for(int i=0;i<HOST_RAYS_PIPELINE_LENGTH;i++)
-    m_pipeline[i].resize(in_blockSize);
+    ThickLensRaysArgs args;
+    args.qmcTable  = &table[0][0];
+    args.qmcBytes  = &m_qmcBytes;
+    args.qmcStart  = unsigned(m_globalCounter);
+    args.fwidth    = m_fwidth;
+    args.fheight   = m_fheight;
+    args.physSizeX = m_physSize.x;
+    args.physSizeY = m_physSize.y;
+    args.lens      = &m_thickLens;
+    args.aperture  = &m_aperture;
+    args.crop      = &m_crop;
+    m_kernels->MakeRaysThick(args, out_rayPosAndNear, out_rayDirAndFar, m_pipeline[putID].data(), int(in_blockSize));
   }
-
-  const int putID = passId % HOST_RAYS_PIPELINE_LENGTH;
-
-  #pragma omp parallel for
-  for(int i=0;i<in_blockSize;i++)
+  else
   {
-    const float sensX = hr_qmc::rndFloat(m_globalCounter+i, 0, table[0]);
-    const float sensY = hr_qmc::rndFloat(m_globalCounter+i, 1, table[0]);
-    const float lensX = hr_qmc::rndFloat(m_globalCounter+i, 2, table[0]);
-    const float lensY = hr_qmc::rndFloat(m_globalCounter+i, 3, table[0]);
-    const float2 xy   = 0.25f*m_physSize*float2(2.0f*sensX - 1.0f, 2.0f*sensY - 1.0f);
-
-    const float x  = m_fwidth*sensX;  
-    const float y  = m_fheight*sensY;
-
-    float3 ray_pos = float3(xy.x, xy.y, 0);
-    
-    const float2 rareSam  = LensRearRadius()*2.0f*MapSamplesToDisc(float2(lensX - 0.5f, lensY - 0.5f));
-    const float3 shootTo  = float3(rareSam.x, rareSam.y, LensRearZ());
-    const float3 ray_dirF = normalize(shootTo - ray_pos);
-    const float cosTheta  = std::abs(ray_dirF.z);
-    
-    float3 ray_dir = ray_dirF;
-    bool rayIsDead = false;
-    if (!TraceLensesFromFilm(ray_pos, ray_dir, &ray_pos, &ray_dir)) 
-    {
-      ray_pos = float3(0,-10000000.0,0.0); // shoot ray under the floor
-      ray_dir = float3(0,-1,0);
-      rayIsDead = true;
-    }
-    else
-    {
-      ray_dir = float3(-1,-1,-1)*normalize(ray_dir);
-      ray_pos = float3(-1,-1,-1)*ray_pos;
-    }
-
-    RayPart1 p1;
-    p1.origin[0]   = ray_pos.x;
-    p1.origin[1]   = ray_pos.y;
-    p1.origin[2]   = ray_pos.z;
-    if(!rayIsDead)
-      p1.xyPosPacked = packXY1616(int(x), int(y)); 
-    else
-      p1.xyPosPacked = 0xFFFFFFFF;  // packing this value discard contibution from this ray
-
-    RayPart2 p2;
-    p2.direction[0] = ray_dir.x;
-    p2.direction[1] = ray_dir.y;
-    p2.direction[2] = ray_dir.z;
-    p2.dummy        = 0.0f;
-    
-    PipeThrough pipeData;
-    pipeData.cosPower4   = (cosTheta*cosTheta)*(cosTheta*cosTheta);
-    pipeData.packedIndex = p1.xyPosPacked;
-
-    out_rayPosAndNear[i] = p1;
-    out_rayDirAndFar [i] = p2;
-    m_pipeline[putID][i] = pipeData;
+    LensRaysArgs args;
+    args.qmcTable  = &table[0][0];
+    args.qmcBytes  = &m_qmcBytes;
+    args.qmcStart  = unsigned(m_globalCounter);
+    args.fwidth    = m_fwidth;
+    args.fheight   = m_fheight;
+    args.physSizeX = m_physSize.x;
+    args.physSizeY = m_physSize.y;
+    args.lines     = lines.data();
+    args.linesNum  = int(lines.size());
+    args.aperture  = &m_aperture;
+    args.crop      = &m_crop;
+    m_kernels->MakeRaysLens(args, out_rayPosAndNear, out_rayDirAndFar, m_pipeline[putID].data(), int(in_blockSize));
   }
 
   //std::this_thread::sleep_for(std::chrono::milliseconds(50)); // test big delay
 
-  m_globalCounter += unsigned(in_blockSize);
+  EndBlock(out_rayPosAndNear, out_rayDirAndFar, in_blockSize, putID);
 } 
 
-void TableLens::AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId)
-{
-  const int takeID = (passId + HOST_RAYS_PIPELINE_LENGTH - 2) % HOST_RAYS_PIPELINE_LENGTH;
-
-  float4*       out_color = (float4*)out_color4f;
-  const float4* colors    = (const float4*)colors4f;
-  
-  for (int i = 0; i < in_blockSize; i++)
-  {
-    const auto color = colors[i];
-    const int packedIndex = as_int(color.w);
-    const int x      = (packedIndex & 0x0000FFFF);         ///<! extract x position from color.w
-    const int y      = (packedIndex & 0xFFFF0000) >> 16;   ///<! extract y position from color.w
-    const int offset = y*a_width + x;
-
-    if (x >= 0 && y >= 0 && x < a_width && y < a_height && dot3f(color, color) > 0.0f)
-    {
-      const PipeThrough& passData = m_pipeline[takeID][i];
-      assert(passData.packedIndex == packedIndex);        ///<! check that we actually took data from 'm_pipeline' for right ray
-      out_color[offset].x += color.x*passData.cosPower4;
-      out_color[offset].y += color.y*passData.cosPower4;
-      out_color[offset].z += color.z*passData.cosPower4;
-    }
-  }
-  
-  // New after FinishRendering()
-  //
-  const double contribSPP = double(in_blockSize) / (double(m_fwidth)*double(m_fheight));
-  m_sppDone += contribSPP;
-  m_lastFbPointer = out_color4f; // jst remember the pointer for demo purposes
-}
-
-void TableLens::FinishRendering()
-{
-  const float normConst = float(1.0/m_sppDone);
-  const float invGamma  = 1.0f/2.2f;
-
-  std::vector<uint32_t> pixelData(m_width*m_height);
-  const float4* realColor = (const float4*)m_lastFbPointer;
-
-  #pragma omp parallel for
-  for(int i=0;i<m_width*m_height;i++)
-  {
-    float4 color = realColor[i]*normConst;
-    color.x      = std::pow(color.x, invGamma);
-    color.y      = std::pow(color.y, invGamma);
-    color.z      = std::pow(color.z, invGamma);
-    color.w      = 1.0f;
-    pixelData[i] = RealColorToUint32(clamp(color, 0.0f, 1.0f));
-  }
-
-  SaveBMP("z_alex_image.bmp", pixelData.data(), m_width, m_height);
-}
-
-IHostRaysAPI* CreateTableLens() { return new TableLens; }
\ No newline at end of file
+HostRaysBase* CreateTableLens(const HostKernels* a_kernels) { return new TableLens(a_kernels); }
\ No newline at end of file
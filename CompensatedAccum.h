@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+#include "HostKernels.h"
+
+/**
+  \brief Optional precision-safe accumulation for high spp. Read from <accumulation> node of camera:
+
+    <accumulation compensated="1" />
+
+  Samples of a block are scattered into 'm_block' first; it gets only few samples per pixel, so float is enough there.
+  After every block the tiles it touched (COMP_TILE_PIXELS contiguous pixels each) are folded into framebuffer with Kahan summation,
+  and the lost low order bits are kept in 'm_comp'. A block of N samples touches at most N tiles, so folding costs O(1) per sample
+  instead of O(frame) per block, and framebuffer is complete after every AddSamplesContribution.
+  Memory overhead is two float4 images of framebuffer size (32 bytes per pixel) and one byte per tile.
+*/
+struct CompensatedAccum
+{
+  void ReadFromNode(pugi::xml_node a_accumNode)
+  {
+    enabled = a_accumNode.attribute(L"compensated").as_bool(false);
+  }
+
+  /**
+  \brief forget compensation of previous render; call when a new render starts, Hydra clears framebuffer then
+  */
+  void Reset()
+  {
+    std::fill(m_block.begin(), m_block.end(), 0.0f);
+    std::fill(m_comp.begin(),  m_comp.end(),  0.0f);
+    std::fill(m_dirty.begin(), m_dirty.end(), uint8_t(0));
+    m_tiles.clear();
+  }
+
+  /**
+  \brief framebuffer for AddContribution of this block: scratch buffer if enabled, 'a_frameBuffer' itself otherwise
+  */
+  float* BlockTarget(float* a_frameBuffer, uint32_t a_width, uint32_t a_height)
+  {
+    if(!enabled)
+      return a_frameBuffer;
+
+    const size_t floatsNum = size_t(a_width)*size_t(a_height)*4;
+    if(m_block.size() != floatsNum)
+    {
+      m_block.assign(floatsNum, 0.0f);
+      m_comp.assign(floatsNum, 0.0f);
+      m_dirty.assign((floatsNum/4 + COMP_TILE_PIXELS - 1)/COMP_TILE_PIXELS, 0);
+      m_tiles.clear();
+    }
+    return m_block.data();
+  }
+
+  /**
+  \brief call after AddContribution of every block with the same colors; folds tiles of scratch buffer that the block touched
+  */
+  void EndBlock(const HostKernels* a_kernels, float* a_frameBuffer, const float* a_colors4f, size_t a_blockSize, uint32_t a_width, uint32_t a_height)
+  {
+    if(!enabled || m_block.empty())
+      return;
+
+    // the same pixel test as AddContribution; dead rays are outside of framebuffer
+    //
+    for(size_t i=0;i<a_blockSize;i++)
+    {
+      uint32_t packedIndex;
+      memcpy(&packedIndex, a_colors4f + i*4 + 3, sizeof(uint32_t));
+      const uint32_t x = (packedIndex & 0x0000FFFF);
+      const uint32_t y = (packedIndex & 0xFFFF0000) >> 16;
+      if(x >= a_width || y >= a_height)
+        continue;
+      const size_t tileId = (size_t(y)*size_t(a_width) + size_t(x))/COMP_TILE_PIXELS;
+      if(m_dirty[tileId] == 0)
+      {
+        m_dirty[tileId] = 1;
+        m_tiles.push_back(int(tileId));
+      }
+    }
+
+    if(m_tiles.empty())
+      return;
+    a_kernels->FoldCompensated(a_frameBuffer, m_comp.data(), m_block.data(), m_tiles.data(), int(m_tiles.size()), int(m_block.size()));
+    for(auto tileId : m_tiles)
+      m_dirty[tileId] = 0;
+    m_tiles.clear();
+  }
+
+  bool enabled = false;
+
+  std::vector<float>   m_block; ///<! samples of the current block
+  std::vector<float>   m_comp;  ///<! Kahan compensation of framebuffer
+  std::vector<uint8_t> m_dirty; ///<! 1 for tiles in 'm_tiles'
+  std::vector<int>     m_tiles; ///<! tiles touched by the current block
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <iostream>
+#include <cmath>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+
+/**
+  \brief Region of film where samples are generated. Read from <crop> node of camera, in framebuffer pixels (x1, y1 are exclusive):
+
+    <crop x0="256" y0="128" x1="512" y1="384" />
+
+  or in normalized film coordinates:
+
+    <crop x0="0.25" y0="0.125" x1="0.5" y1="0.375" normalized="1" />
+
+  Region is snapped to whole pixels so that every pixel inside it gets the same sample density.
+  Without this node the whole film is used.
+*/
+struct CropWindow
+{
+  void ReadFromNode(pugi::xml_node a_cropNode, int a_width, int a_height)
+  {
+    int px0 = 0, py0 = 0, px1 = a_width, py1 = a_height;
+    if(a_cropNode != nullptr)
+    {
+      if(a_cropNode.attribute(L"normalized").as_bool())
+      {
+        px0 = int(std::floor(a_cropNode.attribute(L"x0").as_float(0.0f)*float(a_width)));
+        py0 = int(std::floor(a_cropNode.attribute(L"y0").as_float(0.0f)*float(a_height)));
+        px1 = int(std::ceil (a_cropNode.attribute(L"x1").as_float(1.0f)*float(a_width)));
+        py1 = int(std::ceil (a_cropNode.attribute(L"y1").as_float(1.0f)*float(a_height)));
+      }
+      else
+      {
+        px0 = a_cropNode.attribute(L"x0").as_int(0);
+        py0 = a_cropNode.attribute(L"y0").as_int(0);
+        px1 = a_cropNode.attribute(L"x1").as_int(a_width);
+        py1 = a_cropNode.attribute(L"y1").as_int(a_height);
+      }
+
+      px0 = (px0 < 0) ? 0 : ((px0 > a_width)  ? a_width  : px0);
+      px1 = (px1 < 0) ? 0 : ((px1 > a_width)  ? a_width  : px1);
+      py0 = (py0 < 0) ? 0 : ((py0 > a_height) ? a_height : py0);
+      py1 = (py1 < 0) ? 0 : ((py1 > a_height) ? a_height : py1);
+
+      if(px1 <= px0 || py1 <= py0)
+      {
+        std::cout << "[CropWindow::ReadFromNode]: empty crop window, whole film is used" << std::endl;
+        px0 = 0; py0 = 0; px1 = a_width; py1 = a_height;
+      }
+    }
+
+    minX      = float(px0)/float(a_width);
+    minY      = float(py0)/float(a_height);
+    sizeX     = float(px1 - px0)/float(a_width);
+    sizeY     = float(py1 - py0)/float(a_height);
+    pixelsNum = double(px1 - px0)*double(py1 - py0);
+    pixelY0   = py0;
+    pixelY1   = py1;
+  }
+
+  float  minX      = 0.0f;  ///<! normalized film coordinates of region
+  float  minY      = 0.0f;
+  float  sizeX     = 1.0f;
+  float  sizeY     = 1.0f;
+  double pixelsNum = 0.0;   ///<! pixels inside region; spp of a block is its size divided by this number
+  int    pixelY0   = 0;     ///<! rows of framebuffer touched by samples, [pixelY0, pixelY1)
+  int    pixelY1   = 0;
+};
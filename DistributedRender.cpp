@@ -0,0 +1,133 @@
+#include "DistributedRender.h"
+#include "Bitmap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+#include "Tonemap.h"
+
+struct PartialHeader
+{
+  char     magic[8];  ///<! "HCAMPART"
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved;
+  double   sppDone;
+  uint64_t samples;
+};
+
+struct PartialExposure        ///<! goes after image since version 2
+{
+  uint32_t autoExposure;
+  uint32_t filmic;
+  float    compensation;
+  float    lowFraction;
+  float    highFraction;
+  uint32_t binsNum;          ///<! LUM_HIST_BINS
+  uint64_t histogram[LUM_HIST_BINS];
+};
+
+static_assert(sizeof(PartialHeader) == 40, "PartialHeader is a part of on-disk format; change PARTIAL_VERSION together with it");
+static_assert(sizeof(PartialExposure) == 24 + 8*LUM_HIST_BINS, "PartialExposure is a part of on-disk format; change PARTIAL_VERSION together with it");
+
+static const char     PARTIAL_MAGIC[8]  = {'H','C','A','M','P','A','R','T'};
+static const uint32_t PARTIAL_VERSION   = 2;
+
+bool SavePartialResult(const char* fname, const float* color4f, int w, int h, double sppDone, uint64_t samples, const AutoExposure* exposure)
+{
+  FILE* f = fopen(fname, "wb");
+  if(f == NULL)
+    return false;
+
+  PartialHeader header;
+  memcpy(header.magic, PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC));
+  header.version  = PARTIAL_VERSION;
+  header.width    = uint32_t(w);
+  header.height   = uint32_t(h);
+  header.reserved = 0;
+  header.sppDone  = sppDone;
+  header.samples  = samples;
+
+  const AutoExposure defaultExposure;
+  if(exposure == nullptr)
+    exposure = &defaultExposure;
+
+  PartialExposure expBlock;
+  expBlock.autoExposure = exposure->autoExposure ? 1 : 0;
+  expBlock.filmic       = exposure->filmic ? 1 : 0;
+  expBlock.compensation = exposure->compensation;
+  expBlock.lowFraction  = exposure->lowFraction;
+  expBlock.highFraction = exposure->highFraction;
+  expBlock.binsNum      = LUM_HIST_BINS;
+  memcpy(expBlock.histogram, exposure->histogram, sizeof(expBlock.histogram));
+
+  const size_t floatsNum = size_t(w)*size_t(h)*4;
+  bool ok = (fwrite(&header, sizeof(PartialHeader), 1, f) == 1);
+  ok      = ok && (fwrite(color4f, sizeof(float), floatsNum, f) == floatsNum);
+  ok      = ok && (fwrite(&expBlock, sizeof(PartialExposure), 1, f) == 1);
+  fclose(f);
+  return ok;
+}
+
+bool LoadPartialResult(const char* fname, PartialResult* pResult)
+{
+  FILE* f = fopen(fname, "rb");
+  if(f == NULL)
+    return false;
+
+  PartialHeader header;
+  if(fread(&header, sizeof(PartialHeader), 1, f) != 1 || memcmp(header.magic, PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC)) != 0 || header.version < 1 || header.version > PARTIAL_VERSION)
+  {
+    fclose(f);
+    return false;
+  }
+
+  pResult->width   = int(header.width);
+  pResult->height  = int(header.height);
+  pResult->sppDone = header.sppDone;
+  pResult->samples = header.samples;
+  pResult->color.resize(size_t(header.width)*size_t(header.height)*4);
+
+  bool ok = (fread(pResult->color.data(), sizeof(float), pResult->color.size(), f) == pResult->color.size());
+
+  pResult->exposure = AutoExposure();
+  if(ok && header.version >= 2)
+  {
+    PartialExposure expBlock;
+    ok = (fread(&expBlock, sizeof(PartialExposure), 1, f) == 1) && (expBlock.binsNum == LUM_HIST_BINS);
+    if(ok)
+    {
+      pResult->exposure.autoExposure = (expBlock.autoExposure != 0);
+      pResult->exposure.filmic       = (expBlock.filmic != 0);
+      pResult->exposure.compensation = expBlock.compensation;
+      pResult->exposure.lowFraction  = expBlock.lowFraction;
+      pResult->exposure.highFraction = expBlock.highFraction;
+      memcpy(pResult->exposure.histogram, expBlock.histogram, sizeof(expBlock.histogram));
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+void ToneMapFramebuffer(const float* color4f, int w, int h, double sppDone,
+                        void (*a_toneMap)(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst),
+                        float a_exposure, std::vector<uint32_t>* out_pixels)
+{
+  const float normConst = (sppDone > 0.0) ? float(double(a_exposure)/sppDone) : 0.0f;
+
+  out_pixels->resize(size_t(w)*size_t(h));
+  if(a_toneMap != nullptr)
+    a_toneMap(color4f, out_pixels->data(), w*h, normConst);
+  else
+    ToneMapPixels(color4f, out_pixels->data(), w*h, normConst);
+}
+
+void SaveFramebufferBMP(const char* fname, const float* color4f, int w, int h, double sppDone,
+                        void (*a_toneMap)(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst), float a_exposure)
+{
+  std::vector<uint32_t> pixelData;
+  ToneMapFramebuffer(color4f, w, h, sppDone, a_toneMap, a_exposure, &pixelData);
+  SaveBMP(fname, pixelData.data(), w, h);
+}
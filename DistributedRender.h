@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+#include "Exposure.h"
+
+/**
+  \brief Slice of QMC sequence rendered by this node. Read from <distributed> node of camera:
+
+    <distributed offset="1" stride="4" partial_output="z_part_1.hpart" />
+
+  'offset' and 'stride' are measured in ray blocks because block size is chosen by device:
+  node k of N uses offset="k" stride="N", so nodes take blocks k, k+N, k+2N, ... of the sequence a single node would render.
+  All nodes must run on devices with the same block size. Without this node offset is 0 and stride is 1.
+*/
+struct SampleRange
+{
+  void ReadFromNode(pugi::xml_node a_distrNode)
+  {
+    offset = 0;
+    stride = 1;
+    partialOutput.clear();
+    if(a_distrNode == nullptr)
+      return;
+    offset = a_distrNode.attribute(L"offset").as_uint(0);
+    stride = a_distrNode.attribute(L"stride").as_uint(1);
+    if(stride == 0)
+      stride = 1;
+    partialOutput = a_distrNode.attribute(L"partial_output").as_string();
+  }
+
+  /**
+  \brief QMC index of the first sample of local block 'a_blockId'; 64 bit, because offset + blockId*stride blocks of 1M rays overflow 32 bits quickly
+  */
+  uint64_t BlockStart(unsigned int a_blockId, size_t a_blockSize) const { return (uint64_t(offset) + uint64_t(a_blockId)*uint64_t(stride))*uint64_t(a_blockSize); }
+
+  unsigned int offset = 0;
+  unsigned int stride = 1;
+  std::wstring partialOutput;
+};
+
+/**
+  \brief Accumulated float framebuffer of one node with sample totals; partials of disjoint ranges are merged by summation.
+*/
+struct PartialResult
+{
+  int      width   = 0;
+  int      height  = 0;
+  double   sppDone = 0.0; ///<! samples per pixel accumulated in 'color'
+  uint64_t samples = 0;   ///<! total rays contributed to 'color'
+  std::vector<float> color; ///<! float4 image, width*height*4
+  AutoExposure exposure;    ///<! exposure settings and luminance histogram of samples in 'color'; histograms of partials are summed too
+};
+
+/**
+\brief save partial result in compact binary format: 40 byte header, raw float4 image and exposure block with histogram
+\param fname    - file name
+\param color4f  - float4 image of size w*h
+\param w        - image width
+\param h        - image height
+\param sppDone  - samples per pixel accumulated in image
+\param samples  - total rays accumulated in image
+\param exposure - optional exposure settings and histogram, so that merged image is metered from all samples
+\return false if file can't be written
+*/
+bool SavePartialResult(const char* fname, const float* color4f, int w, int h, double sppDone, uint64_t samples, const AutoExposure* exposure = nullptr);
+
+/**
+\brief load partial result saved with SavePartialResult; files of version 1 have no exposure block, default exposure is used for them
+\return false if file is missing or has wrong format
+*/
+bool LoadPartialResult(const char* fname, PartialResult* pResult);
+
+/**
+\brief normalize accumulated float4 image by 'sppDone' and tonemap it to packed 8 bit RGBA
+\param a_toneMap  - optional tonemap kernel from HostKernels; if null, generic implementation is used
+\param a_exposure - factor for normalized colors
+\param out_pixels - w*h pixels
+*/
+void ToneMapFramebuffer(const float* color4f, int w, int h, double sppDone,
+                        void (*a_toneMap)(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst),
+                        float a_exposure, std::vector<uint32_t>* out_pixels);
+
+/**
+\brief normalize accumulated float4 image by 'sppDone', apply gamma 2.2 and save it as 24 bit bmp
+\param a_toneMap  - optional tonemap kernel from HostKernels; if null, generic implementation is used
+\param a_exposure - factor for normalized colors
+*/
+void SaveFramebufferBMP(const char* fname, const float* color4f, int w, int h, double sppDone,
+                        void (*a_toneMap)(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst) = nullptr,
+                        float a_exposure = 1.0f);
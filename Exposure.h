@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <math.h>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+#include "HostKernels.h"
+
+/**
+  \brief Exposure of final image. Read from <exposure> node of camera:
+
+    <exposure auto="1" compensation="-0.5" tonemap="filmic" meter_low="0.1" meter_high="0.9" />
+
+  With auto="1" the image is scaled so that average luminance maps to middle gray; 'compensation' is in stops (EV)
+  and is applied in any case. 'tonemap' is "gamma" (default, gamma 2.2 only) or "filmic".
+  'meter_low' and 'meter_high' are fractions of samples, darkest first, that are averaged for metering.
+
+  Statistics are gathered from samples in AddSamplesContribution, so no pass over the framebuffer is needed to find exposure.
+*/
+struct AutoExposure
+{
+  void ReadFromNode(pugi::xml_node a_expNode)
+  {
+    autoExposure = a_expNode.attribute(L"auto").as_bool(false);
+    compensation = a_expNode.attribute(L"compensation").as_float(0.0f);
+    filmic       = (std::wstring(a_expNode.attribute(L"tonemap").as_string(L"gamma")) == L"filmic");
+    lowFraction  = a_expNode.attribute(L"meter_low").as_float(0.1f);
+    highFraction = a_expNode.attribute(L"meter_high").as_float(0.9f);
+  }
+
+  /**
+  \brief forget samples of previous render; called together with reset of sample totals, see HostRaysBase::SetParameters
+  */
+  void Clear()
+  {
+    for(int b=0;b<LUM_HIST_BINS;b++)
+      histogram[b] = 0;
+  }
+
+  /**
+  \brief add histogram of one block computed by HostKernels::LumHistogram
+  */
+  void AddBlock(const uint32_t* a_bins)
+  {
+    for(int b=0;b<LUM_HIST_BINS;b++)
+      histogram[b] += a_bins[b];
+  }
+
+  /**
+  \brief add histogram gathered by another render node
+  */
+  void Merge(const AutoExposure& a_other)
+  {
+    for(int b=0;b<LUM_HIST_BINS;b++)
+      histogram[b] += a_other.histogram[b];
+  }
+
+  /**
+  \brief average log2 luminance of samples between 'a_lowFraction' and 'a_highFraction' of histogram, darkest first;
+         darkest and brightest samples are ignored, so black background and fireflies do not move exposure much
+  */
+  float AverageLog2(float a_lowFraction, float a_highFraction) const
+  {
+    uint64_t total = 0;
+    for(int b=0;b<LUM_HIST_BINS;b++)
+      total += histogram[b];
+    if(total == 0)
+      return 0.0f;
+
+    const double binSize = double(LUM_HIST_MAX_LOG2 - LUM_HIST_MIN_LOG2)/double(LUM_HIST_BINS);
+    const double low     = double(a_lowFraction)*double(total);
+    const double high    = double(a_highFraction)*double(total);
+
+    double before = 0.0, sum = 0.0, weight = 0.0;
+    for(int b=0;b<LUM_HIST_BINS;b++)
+    {
+      const double count = double(histogram[b]);
+      const double from  = (before > low)           ? before : low;   // part of bin inside [low, high]
+      const double to    = (before + count < high)  ? before + count : high;
+      if(to > from)
+      {
+        sum    += (to - from)*(double(LUM_HIST_MIN_LOG2) + (double(b) + 0.5)*binSize);
+        weight += (to - from);
+      }
+      before += count;
+    }
+    return (weight > 0.0) ? float(sum/weight) : 0.0f;
+  }
+
+  /**
+  \brief factor for normalized (divided by spp) colors
+  */
+  float Scale() const
+  {
+    const float manual = exp2f(compensation);
+    if(!autoExposure)
+      return manual;
+    const float middleGray = 0.18f;
+    return manual*middleGray/exp2f(AverageLog2(lowFraction, highFraction));
+  }
+
+  bool  autoExposure = false;
+  bool  filmic       = false;
+  float compensation = 0.0f;   ///<! in stops
+  float lowFraction  = 0.1f;   ///<! metering window
+  float highFraction = 0.9f;   ///<!
+  uint64_t histogram[LUM_HIST_BINS] = {};
+};
@@ -0,0 +1,10 @@
+#include "HashBytes.h"
+
+uint64_t HashBytes(const void* a_data, size_t a_size, uint64_t a_seed)
+{
+  uint64_t hash = a_seed;
+  const unsigned char* bytes = (const unsigned char*)a_data;
+  for(size_t i=0;i<a_size;i++)
+    hash = (hash ^ uint64_t(bytes[i]))*1099511628211ull;
+  return hash;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+static const uint64_t HASH_SEED = 14695981039346656037ull; ///<! FNV-1a offset basis
+
+/**
+\brief FNV-1a hash of 'a_size' bytes continued from 'a_seed'; start a new hash with HASH_SEED
+*/
+uint64_t HashBytes(const void* a_data, size_t a_size, uint64_t a_seed);
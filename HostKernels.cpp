@@ -0,0 +1,675 @@
+#include "HostKernels.h"
+#include "CamHostPluginAPI.h"
+#include "Aperture.h"
+#include "CropWindow.h"
+#include "LensElement.h"
+#include "KernelMath.h"
+#include "HostRaysLanes.h"
+#include "LensTrace.h"
+#include "Tonemap.h"
+#include "RayGenerator.h"
+
+#include <cassert>
+#include <cstdint>
+#include <math.h>
+
+// compiled once per instruction set with HOST_KERNELS_ISA set to the variant name (see CMakeLists.txt and HostKernels.h)
+//
+#ifndef HOST_KERNELS_ISA
+  #define HOST_KERNELS_ISA generic
+#endif
+
+#define HK_CONCAT_IMPL(a,b) a##b
+#define HK_CONCAT(a,b)      HK_CONCAT_IMPL(a,b)
+#define HK_STR_IMPL(a)      #a
+#define HK_STR(a)           HK_STR_IMPL(a)
+#define HK_NAMESPACE        HK_CONCAT(hk_, HOST_KERNELS_ISA)
+
+// kernels and their functors have different names in every build; headers above have only internal linkage functions
+//
+namespace HK_NAMESPACE
+{
+  using kmath::float3;
+  using kmath::make_float3;
+  using kmath::as_int;
+  using kmath::minInt;
+
+  /**
+  \brief aperture sample for [0,1)^2 lens samples of lane group, unit circle is the full radius
+  */
+  static inline void SampleApertureLanes(const ApertureShape* a_aperture, const float* a_lensX, const float* a_lensY, const float* a_lensW, float* out_x, float* out_y)
+  {
+    if(a_aperture->type != ApertureShape::APERTURE_DISC)
+    {
+      a_aperture->SampleLanes(a_lensX, a_lensY, a_lensW, out_x, out_y);
+      return;
+    }
+
+    alignas(32) float cx[RAY_LANES], cy[RAY_LANES];
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      cx[i] = a_lensX[i] - 0.5f;
+      cy[i] = a_lensY[i] - 0.5f;
+    }
+    MapSamplesToDiscLanes(cx, cy, out_x, out_y);
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      out_x[i] *= 2.0f;
+      out_y[i] *= 2.0f;
+    }
+  }
+
+  /**
+  \brief pinhole rays through precomputed film basis; with DOF_ENABLED ray starts on thin lens and passes through the point of focal plane
+  */
+  template<bool DOF_ENABLED>
+  struct DofMapping
+  {
+    static constexpr bool LENS_SAMPLES = DOF_ENABLED;
+
+    DofMapping(const DOFRaysArgs& a_args) : film(a_args.film), aperture(a_args.aperture), fwidth(a_args.fwidth), fheight(a_args.fheight),
+                                            focalPlane(a_args.focalPlaneDist), lensScale(a_args.lensRadius) { }
+
+    bool LensJitter() const { return DOF_ENABLED && aperture->NeedsJitter(); }
+
+    void operator()(const float* a_sensX, const float* a_sensY, const float* a_lensX, const float* a_lensY, const float* a_lensW, RayLanes& out_rays) const
+    {
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float x    = fwidth *a_sensX[i];
+        const float y    = fheight*a_sensY[i];
+        const float hx   = film.origin[0] + x*film.dx[0] + y*film.dy[0];
+        const float hy   = film.origin[1] + x*film.dx[1] + y*film.dy[1];
+        const float hz   = film.origin[2] + x*film.dx[2] + y*film.dy[2];
+        const float hw   = film.origin[3] + x*film.dx[3] + y*film.dy[3];
+        const float invW = 1.0f/hw;
+        const float dx   = hx*invW;
+        const float dy   = -hy*invW;
+        const float dz   = hz*invW;
+        const float invL = 1.0f/sqrtf(dx*dx + dy*dy + dz*dz);
+        out_rays.posX[i]   = 0.0f;
+        out_rays.posY[i]   = 0.0f;
+        out_rays.posZ[i]   = 0.0f;
+        out_rays.dirX[i]   = dx*invL;
+        out_rays.dirY[i]   = dy*invL;
+        out_rays.dirZ[i]   = dz*invL;
+        out_rays.weight[i] = 1.0f;
+      }
+
+      if(!DOF_ENABLED)
+        return;
+
+      alignas(32) float discX[RAY_LANES], discY[RAY_LANES];
+      SampleApertureLanes(aperture, a_lensX, a_lensY, a_lensW, discX, discY);
+
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float tFocus = focalPlane / (-out_rays.dirZ[i]);
+        const float focusX = out_rays.dirX[i]*tFocus;
+        const float focusY = out_rays.dirY[i]*tFocus;
+        const float focusZ = out_rays.dirZ[i]*tFocus;
+        const float posX   = lensScale*discX[i];
+        const float posY   = lensScale*discY[i];
+        const float dx     = focusX - posX;
+        const float dy     = focusY - posY;
+        const float dz     = focusZ;
+        const float invL   = 1.0f/sqrtf(dx*dx + dy*dy + dz*dz);
+        out_rays.posX[i] = posX;
+        out_rays.posY[i] = posY;
+        out_rays.dirX[i] = dx*invL;
+        out_rays.dirY[i] = dy*invL;
+        out_rays.dirZ[i] = dz*invL;
+      }
+    }
+
+    FilmBasis            film;
+    const ApertureShape* aperture;
+    float fwidth, fheight, focalPlane, lensScale;
+  };
+
+  void MakeRaysDOF(const DOFRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize)
+  {
+    if(a_args.dofEnabled)
+      GenerateRays(DofMapping<true>(a_args), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, *(a_args.crop),
+                   out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+    else
+      GenerateRays(DofMapping<false>(a_args), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, *(a_args.crop),
+                   out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+  }
+
+  /**
+  \brief rays from film point to rear element, traced through all lines of tabular lens; weight is cos^4 of the initial direction
+  */
+  struct LensMapping
+  {
+    static constexpr bool LENS_SAMPLES = true;
+
+    LensMapping(const LensRaysArgs& a_args) : lines(a_args.lines), linesNum(a_args.linesNum), aperture(a_args.aperture)
+    {
+      rearZ      = (a_args.linesNum > 0) ? a_args.lines[0].thickness      : 0.0f;
+      rearRadius = (a_args.linesNum > 0) ? a_args.lines[0].apertureRadius : 0.0f;
+      halfSizeX  = 0.25f*a_args.physSizeX;
+      halfSizeY  = 0.25f*a_args.physSizeY;
+    }
+
+    bool LensJitter() const { return false; } // rear element is a disc; aperture stop is only tested with IsOpen
+
+    void operator()(const float* a_sensX, const float* a_sensY, const float* a_lensX, const float* a_lensY, const float*, RayLanes& out_rays) const
+    {
+      if(linesNum == 0) // empty optical_system
+      {
+        for(int i=0;i<RAY_LANES;i++)
+          out_rays.weight[i] = 0.0f;
+        return;
+      }
+
+      alignas(32) float cx[RAY_LANES], cy[RAY_LANES], discX[RAY_LANES], discY[RAY_LANES];
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        cx[i] = a_lensX[i] - 0.5f;
+        cy[i] = a_lensY[i] - 0.5f;
+      }
+      MapSamplesToDiscLanes(cx, cy, discX, discY);
+
+      // tracing branches on every interface, so it stays scalar
+      //
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float3 filmPos  = make_float3(halfSizeX*(2.0f*a_sensX[i] - 1.0f), halfSizeY*(2.0f*a_sensY[i] - 1.0f), 0.0f);
+        const float3 shootTo  = make_float3(rearRadius*2.0f*discX[i], rearRadius*2.0f*discY[i], rearZ);
+        const float3 filmDir  = normalize(shootTo - filmPos);
+        const float  cosTheta = fabsf(filmDir.z);
+
+        float3 rayPos, rayDir;
+        if(!TraceLensesFromFilm(lines, linesNum, aperture, filmPos, filmDir, &rayPos, &rayDir))
+        {
+          out_rays.weight[i] = 0.0f;
+          continue;
+        }
+
+        rayDir = normalize(rayDir);
+        out_rays.posX[i]   = -rayPos.x;
+        out_rays.posY[i]   = -rayPos.y;
+        out_rays.posZ[i]   = -rayPos.z;
+        out_rays.dirX[i]   = -rayDir.x;
+        out_rays.dirY[i]   = -rayDir.y;
+        out_rays.dirZ[i]   = -rayDir.z;
+        out_rays.weight[i] = (cosTheta*cosTheta)*(cosTheta*cosTheta);
+      }
+    }
+
+    const LensElementInterface* lines;
+    int                         linesNum;
+    const ApertureShape*        aperture;
+    float rearZ, rearRadius, halfSizeX, halfSizeY;
+  };
+
+  void MakeRaysLens(const LensRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize)
+  {
+    GenerateRays(LensMapping(a_args), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, *(a_args.crop),
+                 out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+  }
+
+  /**
+  \brief all rays of film point pass through its conjugate point and entrance pupil;
+         film is a plane, so all conjugate points lay on a plane too
+  */
+  struct ThickLensMapping
+  {
+    static constexpr bool LENS_SAMPLES = true;
+
+    ThickLensMapping(const ThickLensRaysArgs& a_args) : aperture(a_args.aperture)
+    {
+      const ThickLens& lens = *(a_args.lens);
+      const float invB = 1.0f/lens.focalLength - 1.0f/lens.rearPrincipalZ;
+      filmToH    = lens.rearPrincipalZ;
+      atInfinity = (fabsf(invB*lens.focalLength) < 1e-6f);
+      conjB      = atInfinity ? 0.0f : 1.0f/invB;
+      conjZ      = lens.frontPrincipalZ + conjB;
+      conjScale  = -conjB/filmToH;
+      dirSign    = (conjB >= 0.0f) ? 1.0f : -1.0f;
+      pupilZ     = lens.entrancePupilZ;
+      pupilR     = lens.entrancePupilRadius;
+      halfSizeX  = 0.25f*a_args.physSizeX;
+      halfSizeY  = 0.25f*a_args.physSizeY;
+    }
+
+    bool LensJitter() const { return aperture->NeedsJitter(); }
+
+    void operator()(const float* a_sensX, const float* a_sensY, const float* a_lensX, const float* a_lensY, const float* a_lensW, RayLanes& out_rays) const
+    {
+      alignas(32) float discX[RAY_LANES], discY[RAY_LANES];
+      SampleApertureLanes(aperture, a_lensX, a_lensY, a_lensW, discX, discY);
+
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float filmX = halfSizeX*(2.0f*a_sensX[i] - 1.0f);
+        const float filmY = halfSizeY*(2.0f*a_sensY[i] - 1.0f);
+        const float qx    = pupilR*discX[i];
+        const float qy    = pupilR*discY[i];
+
+        float dx = dirSign*(conjScale*filmX - qx);
+        float dy = dirSign*(conjScale*filmY - qy);
+        float dz = dirSign*(conjZ - pupilZ);
+        if(atInfinity)
+        {
+          dx = -filmX/filmToH;
+          dy = -filmY/filmToH;
+          dz = 1.0f;
+        }
+        const float invL = 1.0f/sqrtf(dx*dx + dy*dy + dz*dz);
+
+        // from lens space to camera space the same way as for traced rays: x,y and z are negated
+        //
+        out_rays.posX[i] = -qx;
+        out_rays.posY[i] = -qy;
+        out_rays.posZ[i] = -pupilZ;
+        out_rays.dirX[i] = -dx*invL;
+        out_rays.dirY[i] = -dy*invL;
+        out_rays.dirZ[i] = -dz*invL;
+
+        const float cosTheta = filmToH/sqrtf(filmX*filmX + filmY*filmY + filmToH*filmToH); // chief ray
+        out_rays.weight[i]   = (cosTheta*cosTheta)*(cosTheta*cosTheta);
+      }
+    }
+
+    const ApertureShape* aperture;
+    float filmToH, conjB, conjZ, conjScale, dirSign, pupilZ, pupilR, halfSizeX, halfSizeY;
+    bool  atInfinity;
+  };
+
+  void MakeRaysThick(const ThickLensRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize)
+  {
+    GenerateRays(ThickLensMapping(a_args), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, *(a_args.crop),
+                 out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+  }
+
+  /**
+  \brief 360 x 180 degrees panorama; image center looks along -z, film y goes from nadir to zenith
+  */
+  struct EquirectMapping
+  {
+    static constexpr bool LENS_SAMPLES = false;
+    bool LensJitter() const { return false; }
+
+    void operator()(const float* a_sensX, const float* a_sensY, const float*, const float*, const float*, RayLanes& out_rays) const
+    {
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float phi      = 2.0f*3.141592654f*(a_sensX[i] - 0.5f);
+        const float theta    = 3.141592654f*(a_sensY[i] - 0.5f);
+        const float cosTheta = cosf(theta);
+        out_rays.posX[i]   = 0.0f;
+        out_rays.posY[i]   = 0.0f;
+        out_rays.posZ[i]   = 0.0f;
+        out_rays.dirX[i]   = sinf(phi)*cosTheta;
+        out_rays.dirY[i]   = sinf(theta);
+        out_rays.dirZ[i]   = -cosf(phi)*cosTheta;
+        out_rays.weight[i] = 1.0f;
+      }
+    }
+  };
+
+  /**
+  \brief equidistant fisheye: angle from axis is proportional to distance from image center; image circle is inscribed in film
+  */
+  struct FisheyeMapping
+  {
+    static constexpr bool LENS_SAMPLES = false;
+    bool LensJitter() const { return false; }
+
+    FisheyeMapping(const ProjectionRaysArgs& a_args)
+    {
+      const float circleRadius = 0.5f*((a_args.fwidth < a_args.fheight) ? a_args.fwidth : a_args.fheight);
+      scaleX  = a_args.fwidth/circleRadius;
+      scaleY  = a_args.fheight/circleRadius;
+      halfFov = 0.5f*a_args.fisheyeFov;
+    }
+
+    void operator()(const float* a_sensX, const float* a_sensY, const float*, const float*, const float*, RayLanes& out_rays) const
+    {
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        const float x     = scaleX*(a_sensX[i] - 0.5f); // in image circle radii
+        const float y     = scaleY*(a_sensY[i] - 0.5f);
+        const float r     = sqrtf(x*x + y*y);
+        const float invR  = (r > 1e-7f) ? 1.0f/r : 0.0f;
+        const float theta = r*halfFov;
+        const float sinT  = sinf(theta);
+        out_rays.posX[i]   = 0.0f;
+        out_rays.posY[i]   = 0.0f;
+        out_rays.posZ[i]   = 0.0f;
+        out_rays.dirX[i]   = sinT*x*invR;
+        out_rays.dirY[i]   = sinT*y*invR;
+        out_rays.dirZ[i]   = -cosf(theta);
+        out_rays.weight[i] = (r <= 1.0f) ? 1.0f : 0.0f;
+      }
+    }
+
+    float scaleX, scaleY, halfFov;
+  };
+
+  /**
+  \brief parallel rays along -z from rectangle of given size centered at camera position
+  */
+  struct OrthoMapping
+  {
+    static constexpr bool LENS_SAMPLES = false;
+    bool LensJitter() const { return false; }
+
+    OrthoMapping(const ProjectionRaysArgs& a_args) : sizeX(a_args.orthoSizeX), sizeY(a_args.orthoSizeY) {}
+
+    void operator()(const float* a_sensX, const float* a_sensY, const float*, const float*, const float*, RayLanes& out_rays) const
+    {
+      #pragma omp simd
+      for(int i=0;i<RAY_LANES;i++)
+      {
+        out_rays.posX[i]   = sizeX*(a_sensX[i] - 0.5f);
+        out_rays.posY[i]   = sizeY*(a_sensY[i] - 0.5f);
+        out_rays.posZ[i]   = 0.0f;
+        out_rays.dirX[i]   = 0.0f;
+        out_rays.dirY[i]   = 0.0f;
+        out_rays.dirZ[i]   = -1.0f;
+        out_rays.weight[i] = 1.0f;
+      }
+    }
+
+    float sizeX, sizeY;
+  };
+
+  void MakeRaysProjection(const ProjectionRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize)
+  {
+    const CropWindow& crop = *(a_args.crop);
+    switch(a_args.type)
+    {
+      case PROJECTION_FISHEYE:
+        GenerateRays(FisheyeMapping(a_args), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, crop, out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+        break;
+      case PROJECTION_ORTHO:
+        GenerateRays(OrthoMapping(a_args), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, crop, out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+        break;
+      default:
+        GenerateRays(EquirectMapping(), a_args.qmcTable, a_args.qmcBytes, a_args.qmcStart, a_args.fwidth, a_args.fheight, crop, out_rayPosAndNear, out_rayDirAndFar, out_pipeline, a_blockSize);
+        break;
+    };
+  }
+
+  inline uint32_t QuantizeUnit(float a_val, float a_levels) // [0,1] to [0,a_levels]
+  {
+    const float v = a_val*a_levels;
+    return (v <= 0.0f) ? 0u : ((v >= a_levels) ? uint32_t(a_levels) : uint32_t(v));
+  }
+
+  void RadixPass(const uint32_t* a_keys, const uint32_t* a_index, uint32_t* out_keys, uint32_t* out_index, uint32_t* a_histogram, 
+                 int a_blockSize, int a_shift)
+  {
+    const int chunkSize = (a_blockSize + RAY_SORT_CHUNKS - 1)/RAY_SORT_CHUNKS;
+
+    #pragma omp parallel for
+    for(int chunkId=0; chunkId<RAY_SORT_CHUNKS; chunkId++)
+    {
+      uint32_t* hist  = a_histogram + chunkId*256;
+      const int begin = chunkId*chunkSize;
+      const int end   = minInt(begin + chunkSize, a_blockSize);
+      for(int d=0;d<256;d++)
+        hist[d] = 0;
+      for(int i=begin;i<end;i++)
+        hist[(a_keys[i] >> a_shift) & 0xFF]++;
+    }
+
+    // digit-major order keeps sort stable: all rays with digit d from chunk c go before those from chunk c+1
+    //
+    uint32_t sum = 0;
+    for(int d=0;d<256;d++)
+    {
+      for(int chunkId=0; chunkId<RAY_SORT_CHUNKS; chunkId++)
+      {
+        const uint32_t count = a_histogram[chunkId*256 + d];
+        a_histogram[chunkId*256 + d] = sum;
+        sum += count;
+      }
+    }
+
+    #pragma omp parallel for
+    for(int chunkId=0; chunkId<RAY_SORT_CHUNKS; chunkId++)
+    {
+      uint32_t* offsets = a_histogram + chunkId*256;
+      const int begin   = chunkId*chunkSize;
+      const int end     = minInt(begin + chunkSize, a_blockSize);
+      for(int i=begin;i<end;i++)
+      {
+        const uint32_t pos = offsets[(a_keys[i] >> a_shift) & 0xFF]++;
+        out_keys [pos] = a_keys[i];
+        out_index[pos] = a_index[i];
+      }
+    }
+  }
+
+  void SortRays(const RaySortArgs& a_args, RayPart1* io_rayPosAndNear, RayPart2* io_rayDirAndFar, PipeThrough* io_pipeline, int a_blockSize)
+  {
+    if(a_args.mode == RAY_SORT_NONE || a_blockSize < 2)
+      return;
+
+    uint32_t* keys  = a_args.keys;
+    uint32_t* index = a_args.index;
+    int keyBits     = 0;
+
+    if(a_args.mode == RAY_SORT_OCTANT)
+    {
+      keyBits = 8;
+      #pragma omp parallel for
+      for(int i=0;i<a_blockSize;i++)
+      {
+        const RayPart2& p2 = io_rayDirAndFar[i];
+        const uint32_t octant = (p2.direction[0] < 0.0f ? 1u : 0u) | (p2.direction[1] < 0.0f ? 2u : 0u) | (p2.direction[2] < 0.0f ? 4u : 0u);
+        keys [i] = (io_rayPosAndNear[i].xyPosPacked == 0xFFFFFFFF) ? 8u : octant;
+        index[i] = uint32_t(i);
+      }
+    }
+    else
+    {
+      // bounds of live ray origins; per chunk first, because reduction(min/max) is not available in OpenMP 2.0
+      //
+      float boxMin[RAY_SORT_CHUNKS][3], boxMax[RAY_SORT_CHUNKS][3];
+      const int chunkSize = (a_blockSize + RAY_SORT_CHUNKS - 1)/RAY_SORT_CHUNKS;
+
+      #pragma omp parallel for
+      for(int chunkId=0; chunkId<RAY_SORT_CHUNKS; chunkId++)
+      {
+        float bMin[3] = {+1e30f, +1e30f, +1e30f};
+        float bMax[3] = {-1e30f, -1e30f, -1e30f};
+        const int end = minInt((chunkId+1)*chunkSize, a_blockSize);
+        for(int i=chunkId*chunkSize; i<end; i++)
+        {
+          if(io_rayPosAndNear[i].xyPosPacked == 0xFFFFFFFF)
+            continue;
+          for(int k=0;k<3;k++)
+          {
+            const float v = io_rayPosAndNear[i].origin[k];
+            bMin[k] = (v < bMin[k]) ? v : bMin[k];
+            bMax[k] = (v > bMax[k]) ? v : bMax[k];
+          }
+        }
+        for(int k=0;k<3;k++)
+        {
+          boxMin[chunkId][k] = bMin[k];
+          boxMax[chunkId][k] = bMax[k];
+        }
+      }
+
+      float bMin[3] = {+1e30f, +1e30f, +1e30f};
+      float bMax[3] = {-1e30f, -1e30f, -1e30f};
+      for(int chunkId=0; chunkId<RAY_SORT_CHUNKS; chunkId++)
+      {
+        for(int k=0;k<3;k++)
+        {
+          bMin[k] = (boxMin[chunkId][k] < bMin[k]) ? boxMin[chunkId][k] : bMin[k];
+          bMax[k] = (boxMax[chunkId][k] > bMax[k]) ? boxMax[chunkId][k] : bMax[k];
+        }
+      }
+
+      float invSize[3];
+      for(int k=0;k<3;k++)
+        invSize[k] = (bMax[k] > bMin[k]) ? 1.0f/(bMax[k] - bMin[k]) : 0.0f;
+
+      // 5 bits per direction component are most significant, then 3 bits per origin component;
+      // live keys take all 24 bits, so dead rays get bit 24 and sort needs one more pass
+      //
+      keyBits = 25;
+      #pragma omp parallel for
+      for(int i=0;i<a_blockSize;i++)
+      {
+        const RayPart1& p1 = io_rayPosAndNear[i];
+        const RayPart2& p2 = io_rayDirAndFar[i];
+        const uint32_t dx = QuantizeUnit(0.5f*p2.direction[0] + 0.5f, 31.0f);
+        const uint32_t dy = QuantizeUnit(0.5f*p2.direction[1] + 0.5f, 31.0f);
+        const uint32_t dz = QuantizeUnit(0.5f*p2.direction[2] + 0.5f, 31.0f);
+        const uint32_t ox = QuantizeUnit((p1.origin[0] - bMin[0])*invSize[0], 7.0f);
+        const uint32_t oy = QuantizeUnit((p1.origin[1] - bMin[1])*invSize[1], 7.0f);
+        const uint32_t oz = QuantizeUnit((p1.origin[2] - bMin[2])*invSize[2], 7.0f);
+        keys [i] = (p1.xyPosPacked == 0xFFFFFFFF) ? (1u << 24) : ((dx << 19) | (dy << 14) | (dz << 9) | (ox << 6) | (oy << 3) | oz);
+        index[i] = uint32_t(i);
+      }
+    }
+
+    uint32_t* keysTmp  = a_args.keysTmp;
+    uint32_t* indexTmp = a_args.indexTmp;
+    for(int shift=0; shift<keyBits; shift+=8)
+    {
+      RadixPass(keys, index, keysTmp, indexTmp, a_args.histogram, a_blockSize, shift);
+      uint32_t* t1 = keys;  keys  = keysTmp;  keysTmp  = t1;
+      uint32_t* t2 = index; index = indexTmp; indexTmp = t2;
+    }
+
+    #pragma omp parallel for
+    for(int i=0;i<a_blockSize;i++)
+    {
+      const uint32_t j = index[i];
+      a_args.tmpPart1[i] = io_rayPosAndNear[j];
+      a_args.tmpPart2[i] = io_rayDirAndFar[j];
+      if(io_pipeline != nullptr)
+        a_args.tmpPipeline[i] = io_pipeline[j];
+    }
+
+    #pragma omp parallel for
+    for(int i=0;i<a_blockSize;i++)
+    {
+      io_rayPosAndNear[i] = a_args.tmpPart1[i];
+      io_rayDirAndFar [i] = a_args.tmpPart2[i];
+      if(io_pipeline != nullptr)
+        io_pipeline[i] = a_args.tmpPipeline[i];
+    }
+  }
+
+  void AddContribution(float* out_color4f, const float* colors4f, const PipeThrough* a_pipeline, int a_blockSize, uint32_t a_width, uint32_t a_height)
+  {
+    for (int i = 0; i < a_blockSize; i++)
+    {
+      const float* color = colors4f + size_t(i)*4;
+      const uint32_t packedIndex = as_int(color[3]);
+      const int x      = (packedIndex & 0x0000FFFF);         ///<! extract x position from color.w
+      const int y      = (packedIndex & 0xFFFF0000) >> 16;   ///<! extract y position from color.w
+      const int offset = y*a_width + x;
+
+      if (x >= 0 && y >= 0 && x < a_width && y < a_height)
+      {
+        float weight = 1.0f;
+        if(a_pipeline != nullptr)
+        {
+          if(color[0]*color[0] + color[1]*color[1] + color[2]*color[2] <= 0.0f)
+            continue;
+          const PipeThrough& passData = a_pipeline[i];
+          assert(passData.packedIndex == packedIndex);        ///<! check that we actually took data from 'm_pipeline' for right ray
+          weight = passData.cosPower4;
+        }
+        float* out = out_color4f + size_t(offset)*4;
+        out[0] += color[0]*weight;
+        out[1] += color[1]*weight;
+        out[2] += color[2]*weight;
+      }
+    }
+  }
+
+  void FoldCompensated(float* io_sum, float* io_comp, float* io_block, const int* a_tiles, int a_tilesNum, int a_floatsNum)
+  {
+    const int tileSize = COMP_TILE_PIXELS*4;
+
+    #pragma omp parallel for
+    for(int k=0; k<a_tilesNum; k++)
+    {
+      const int begin = a_tiles[k]*tileSize;
+      float* sum   = io_sum   + begin;
+      float* comp  = io_comp  + begin;
+      float* block = io_block + begin;
+      const int size = minInt(tileSize, a_floatsNum - begin);
+
+      #pragma omp simd
+      for(int i=0;i<size;i++)
+      {
+        const float y = block[i] - comp[i];
+        const float t = sum[i] + y;
+        comp[i]  = (t - sum[i]) - y;
+        sum[i]   = t;
+        block[i] = 0.0f;
+      }
+    }
+  }
+
+  void ToneMap(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst) { ToneMapPixels(a_color4f, out_pixels, a_pixelsNum, a_normConst); }
+  void ToneMapFilmic(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst) { ToneMapPixelsFilmic(a_color4f, out_pixels, a_pixelsNum, a_normConst); }
+
+  void LumHistogram(const float* colors4f, const PipeThrough* a_pipeline, int a_blockSize, uint32_t* out_bins)
+  {
+    const int   chunksNum = 16;
+    const int   chunkSize = (a_blockSize + chunksNum - 1)/chunksNum;
+    const float binScale  = float(LUM_HIST_BINS)/(LUM_HIST_MAX_LOG2 - LUM_HIST_MIN_LOG2);
+
+    uint32_t chunkBins[chunksNum][LUM_HIST_BINS];
+
+    #pragma omp parallel for
+    for(int chunkId=0; chunkId<chunksNum; chunkId++)
+    {
+      uint32_t* bins = chunkBins[chunkId];
+      for(int b=0;b<LUM_HIST_BINS;b++)
+        bins[b] = 0;
+
+      const int end = minInt((chunkId+1)*chunkSize, a_blockSize);
+      for(int i=chunkId*chunkSize; i<end; i++)
+      {
+        const float  weight = (a_pipeline == nullptr) ? 1.0f : a_pipeline[i].cosPower4;
+        const float* color  = colors4f + size_t(i)*4;
+        if(!(weight > 0.0f) || uint32_t(as_int(color[3])) == 0xFFFFFFFF) // dead ray, it is not a sample of image
+          continue;
+        const float  lum    = weight*(0.2126f*color[0] + 0.7152f*color[1] + 0.0722f*color[2]);
+        if(!(lum > 0.0f))
+        {
+          bins[0]++; // black sample is darker than any bin
+          continue;
+        }
+        const float binF = (log2f(lum) - LUM_HIST_MIN_LOG2)*binScale;
+        const int   bin  = (binF <= 0.0f) ? 0 : minInt(int(binF), LUM_HIST_BINS-1);
+        bins[bin]++;
+      }
+    }
+
+    for(int b=0;b<LUM_HIST_BINS;b++)
+    {
+      uint32_t sum = 0;
+      for(int chunkId=0; chunkId<chunksNum; chunkId++)
+        sum += chunkBins[chunkId][b];
+      out_bins[b] = sum;
+    }
+  }
+};
+
+const HostKernels* HK_CONCAT(HostKernels_, HOST_KERNELS_ISA)()
+{
+  using namespace HK_NAMESPACE;
+  static const HostKernels kernels = { HK_STR(HOST_KERNELS_ISA), &MakeRaysDOF, &MakeRaysLens, &MakeRaysThick, &MakeRaysProjection, &SortRays, &AddContribution, &FoldCompensated, &ToneMap, &ToneMapFilmic, &LumHistogram };
+  return &kernels;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "CamHostPluginAPI.h"
+
+struct ApertureShape;
+struct LensElementInterface;
+struct ThickLens;
+struct CropWindow;
+struct QmcBytes;
+
+/**
+  \brief per ray data that plugin keeps between MakeRaysBlock and AddSamplesContribution
+*/
+struct PipeThrough
+{
+  float cosPower4      = 1.0f;
+  uint32_t packedIndex = 0;
+};
+
+/**
+  \brief EyeRayDir(x,y) before normalization, precomputed once per SetParameters
+
+    Homogeneous point on film plane is linear in (x,y): pos = origin + x*dx + y*dy;
+    direction is then (pos.x, -pos.y, pos.z)/pos.w normalized, the same as EyeRayDir does.
+*/
+struct FilmBasis
+{
+  float origin[4];
+  float dx[4];
+  float dy[4];
+};
+
+struct DOFRaysArgs
+{
+  const unsigned int*  qmcTable;        ///<! table[0] of hr_qmc
+  const QmcBytes*      qmcBytes;        ///<! byte tables of the same QMC, used if valid, see QmcBytes.h
+  unsigned int         qmcStart;        ///<! QMC index of the first ray in block
+  float                fwidth;
+  float                fheight;
+  FilmBasis            film;
+  bool                 dofEnabled;
+  float                focalPlaneDist;
+  float                lensRadius;
+  const ApertureShape* aperture;
+  const CropWindow*    crop;            ///<! film region where samples are generated
+};
+
+struct LensRaysArgs
+{
+  const unsigned int*         qmcTable; ///<! table[0] of hr_qmc
+  const QmcBytes*             qmcBytes; ///<! byte tables of the same QMC, used if valid, see QmcBytes.h
+  unsigned int                qmcStart; ///<! QMC index of the first ray in block
+  float                       fwidth;
+  float                       fheight;
+  float                       physSizeX;
+  float                       physSizeY;
+  const LensElementInterface* lines;
+  int                         linesNum;
+  const ApertureShape*        aperture;
+  const CropWindow*           crop;     ///<! film region where samples are generated
+};
+
+struct ThickLensRaysArgs
+{
+  const unsigned int*  qmcTable;        ///<! table[0] of hr_qmc
+  const QmcBytes*      qmcBytes;        ///<! byte tables of the same QMC, used if valid, see QmcBytes.h
+  unsigned int         qmcStart;        ///<! QMC index of the first ray in block
+  float                fwidth;
+  float                fheight;
+  float                physSizeX;
+  float                physSizeY;
+  const ThickLens*     lens;
+  const ApertureShape* aperture;
+  const CropWindow*    crop;            ///<! film region where samples are generated
+};
+
+enum RAY_SORT_MODE { RAY_SORT_NONE   = 0, 
+                     RAY_SORT_OCTANT = 1, ///<! by signs of direction
+                     RAY_SORT_HASH   = 2, ///<! by quantized direction, then by quantized origin inside block bounds
+                   };
+
+static const int RAY_SORT_CHUNKS = 64; ///<! radix sort splits block into this number of parts, each has its own histogram
+
+static const int COMP_TILE_PIXELS = 64; ///<! unit of compensated accumulation, contiguous pixels of framebuffer; see CompensatedAccum
+
+static const int   LUM_HIST_BINS     = 64;     ///<! bins of log2 luminance histogram, half stop each
+static const float LUM_HIST_MIN_LOG2 = -16.0f; ///<! lower bound of the first bin
+static const float LUM_HIST_MAX_LOG2 = +16.0f; ///<! upper bound of the last bin
+
+/**
+  \brief scratch memory for SortRays; all arrays have block size, 'histogram' has RAY_SORT_CHUNKS*256 elements
+*/
+struct RaySortArgs
+{
+  RAY_SORT_MODE mode;
+  uint32_t*     keys;
+  uint32_t*     keysTmp;
+  uint32_t*     index;
+  uint32_t*     indexTmp;
+  uint32_t*     histogram;
+  RayPart1*     tmpPart1;
+  RayPart2*     tmpPart2;
+  PipeThrough*  tmpPipeline;
+};
+
+enum PROJECTION_TYPE { PROJECTION_EQUIRECT = 0, ///<! 360 x 180 degrees panorama
+                       PROJECTION_FISHEYE  = 1, ///<! equidistant fisheye
+                       PROJECTION_ORTHO    = 2, ///<! orthographic
+                     };
+
+struct ProjectionRaysArgs
+{
+  const unsigned int* qmcTable;         ///<! table[0] of hr_qmc
+  const QmcBytes*     qmcBytes;         ///<! byte tables of the same QMC, used if valid, see QmcBytes.h
+  unsigned int        qmcStart;         ///<! QMC index of the first ray in block
+  float               fwidth;
+  float               fheight;
+  PROJECTION_TYPE     type;
+  float               fisheyeFov;       ///<! full field of view of image circle, in radians
+  float               orthoSizeX;       ///<! size of orthographic view in camera space
+  float               orthoSizeY;
+  const CropWindow*   crop;             ///<! film region where samples are generated
+};
+
+/**
+  \brief Hot loops of plugins. HostKernels.cpp is compiled once per instruction set and each build fills its own table.
+
+  Inline functions with external linkage (members of cglobals vector types, templates, std overloads) are emitted by every object file
+  that uses them, and linker keeps only one copy; it may be the AVX-512 one, which then runs from generic code on older CPU.
+  So kernel code does not include cglobals.h: headers it shares with plugins (KernelMath.h, HostRaysLanes.h, LensTrace.h, Tonemap.h,
+  RayGenerator.h, QmcBytes.h) have only POD types and static inline functions, and functors of HostKernels.cpp live in namespace hk_<isa>.
+  From other plugin headers (LensElement.h, CropWindow.h, Aperture.h) kernels use data and out of line functions only, and they
+  write PipeThrough fields instead of constructing it. hr_qmc is defined in HydraRngUtils.cpp, which is built without instruction set flags.
+  Kernel code uses C math (sinf, sqrtf), because std overloads are inline functions with external linkage too.
+
+  MSVC has no switch for SSE4.2 alone, so there is no "sse42" build with it and ISA_SSE42 falls back to "generic".
+*/
+struct HostKernels
+{
+  const char* name;
+
+  void (*MakeRaysDOF)    (const DOFRaysArgs&  a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize);
+  void (*MakeRaysLens)   (const LensRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize);
+  void (*MakeRaysThick)  (const ThickLensRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize);
+  void (*MakeRaysProjection)(const ProjectionRaysArgs& a_args, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize);
+
+  /**
+  \brief reorder block of rays by key with stable parallel radix sort; 'io_pipeline' (may be null) is permuted together with rays,
+         so colors that come back in ray order still match their per ray data. Dead rays (xyPosPacked == 0xFFFFFFFF) go to the end.
+  */
+  void (*SortRays)       (const RaySortArgs& a_args, RayPart1* io_rayPosAndNear, RayPart2* io_rayDirAndFar, PipeThrough* io_pipeline, int a_blockSize);
+
+  /**
+  \brief add colors to framebuffer; 'a_pipeline' may be null, otherwise colors are weighted with 'cosPower4' and black samples are skipped
+  */
+  void (*AddContribution)(float* out_color4f, const float* colors4f, const PipeThrough* a_pipeline, int a_blockSize, uint32_t a_width, uint32_t a_height);
+  /**
+  \brief io_sum += io_block with compensated (Kahan) summation inside listed tiles of COMP_TILE_PIXELS pixels, io_comp keeps lost
+         low order bits; these tiles of io_block are cleared. Arrays have 'a_floatsNum' floats, the last tile may be shorter.
+  */
+  void (*FoldCompensated)(float* io_sum, float* io_comp, float* io_block, const int* a_tiles, int a_tilesNum, int a_floatsNum);
+
+  void (*ToneMap)        (const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst);
+  void (*ToneMapFilmic)  (const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst); ///<! ACES fitted curve, then gamma 2.2
+
+  /**
+  \brief histogram of log2 luminance of block samples, LUM_HIST_BINS size; black samples go to the first bin, dead rays are skipped;
+         'a_pipeline' may be null as for AddContribution
+  */
+  void (*LumHistogram)   (const float* colors4f, const PipeThrough* a_pipeline, int a_blockSize, uint32_t* out_bins);
+};
+
+/**
+\brief select kernels for current CPU
+\param a_isaName - optional override: "generic", "sse42", "avx2" or "avx512"; ignored if CPU does not support it
+*/
+const HostKernels* SelectHostKernels(const wchar_t* a_isaName = nullptr);
+
+const HostKernels* HostKernels_generic();
+const HostKernels* HostKernels_sse42();
+const HostKernels* HostKernels_avx2();
+const HostKernels* HostKernels_avx512();
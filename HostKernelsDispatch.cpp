@@ -0,0 +1,126 @@
+#include "HostKernels.h"
+
+#include <iostream>
+#include <string>
+#include <mutex>
+
+#if defined(HOST_KERNELS_X86) && defined(_MSC_VER)
+  #include <intrin.h>
+  #include <immintrin.h>
+#endif
+
+std::string ws2s(const std::wstring& s);
+
+enum HOST_ISA { ISA_GENERIC = 0, ISA_SSE42 = 1, ISA_AVX2 = 2, ISA_AVX512 = 3 };
+
+#if defined(HOST_KERNELS_X86) && defined(_MSC_VER)
+
+static bool CpuidBit(int a_leaf, int a_subLeaf, int a_reg, int a_bit)
+{
+  int regs[4];
+  __cpuidex(regs, a_leaf, a_subLeaf);
+  return (unsigned(regs[a_reg]) & (1u << a_bit)) != 0;
+}
+
+static HOST_ISA DetectHostISA()
+{
+  int regs[4];
+  __cpuid(regs, 0);
+  const int maxLeaf = regs[0];
+
+  const bool sse42   = CpuidBit(1, 0, 2, 20);
+  const bool osxsave = CpuidBit(1, 0, 2, 27);
+  const bool fma     = CpuidBit(1, 0, 2, 12);
+  const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  const bool osAVX    = (xcr0 & 0x06) == 0x06; // XMM and YMM state
+  const bool osAVX512 = (xcr0 & 0xE6) == 0xE6; // and opmask, ZMM state
+
+  if(maxLeaf >= 7 && osAVX512 && CpuidBit(7, 0, 1, 16) && CpuidBit(7, 0, 1, 17) && CpuidBit(7, 0, 1, 30) && CpuidBit(7, 0, 1, 31) && fma)
+    return ISA_AVX512;
+  if(maxLeaf >= 7 && osAVX && CpuidBit(7, 0, 1, 5) && fma)
+    return ISA_AVX2;
+  if(sse42)
+    return ISA_SSE42;
+  return ISA_GENERIC;
+}
+
+#elif defined(HOST_KERNELS_X86)
+
+static HOST_ISA DetectHostISA()
+{
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("fma"))
+    return ISA_AVX512;
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return ISA_AVX2;
+  if(__builtin_cpu_supports("sse4.2"))
+    return ISA_SSE42;
+  return ISA_GENERIC;
+}
+
+#else
+
+static HOST_ISA DetectHostISA() { return ISA_GENERIC; }
+
+#endif
+
+static const HostKernels* KernelsForISA(HOST_ISA a_isa)
+{
+  (void)a_isa; // there is only generic build for other CPUs
+#ifdef HOST_KERNELS_X86
+  switch(a_isa)
+  {
+    case ISA_AVX512: return HostKernels_avx512();
+    case ISA_AVX2:   return HostKernels_avx2();
+#ifndef HOST_KERNELS_NO_SSE42
+    case ISA_SSE42:  return HostKernels_sse42();
+#endif
+    default:         break;
+  };
+#endif
+  return HostKernels_generic();
+}
+
+const HostKernels* SelectHostKernels(const wchar_t* a_isaName)
+{
+  static const HOST_ISA bestISA = DetectHostISA();
+
+  // called on every SetParameters; resolve and report only when override string changes
+  //
+  static std::mutex         lastMutex;
+  static std::wstring       lastName;
+  static const HostKernels* lastKernels = nullptr;
+
+  const std::wstring isaName = (a_isaName == nullptr) ? std::wstring() : std::wstring(a_isaName);
+  std::lock_guard<std::mutex> lock(lastMutex);
+  if(lastKernels != nullptr && isaName == lastName)
+    return lastKernels;
+
+  HOST_ISA isa = bestISA;
+  if(!isaName.empty())
+  {
+    HOST_ISA requested = bestISA;
+    if(isaName == L"generic")
+      requested = ISA_GENERIC;
+    else if(isaName == L"sse42")
+      requested = ISA_SSE42;
+    else if(isaName == L"avx2")
+      requested = ISA_AVX2;
+    else if(isaName == L"avx512")
+      requested = ISA_AVX512;
+    else
+      std::cout << "[SelectHostKernels]: unknown isa '" << ws2s(isaName).c_str() << "'" << std::endl;
+
+    if(requested > bestISA)
+      std::cout << "[SelectHostKernels]: isa '" << ws2s(isaName).c_str() << "' is not supported by this CPU" << std::endl;
+    else
+      isa = requested;
+  }
+
+  const HostKernels* pKernels = KernelsForISA(isa);
+  if(pKernels != lastKernels)
+    std::cout << "[SelectHostKernels]: use '" << pKernels->name << "' kernels" << std::endl;
+  lastName    = isaName;
+  lastKernels = pKernels;
+  return pKernels;
+}
@@ -0,0 +1,107 @@
+#include "HostRaysBase.h"
+#include "Bitmap.h"
+
+#include <iostream>
+
+std::string ws2s(const std::wstring& s);
+
+void HostRaysBase::SetParameters(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText)
+{
+  m_width   = a_width;
+  m_height  = a_height;
+  m_fwidth  = float(a_width);
+  m_fheight = float(a_height);
+  for(int i=0;i<4;i++)
+  {
+    m_projInv.row[i].x = a_projInvMatrix[i*4+0];
+    m_projInv.row[i].y = a_projInvMatrix[i*4+1];
+    m_projInv.row[i].z = a_projInvMatrix[i*4+2];
+    m_projInv.row[i].w = a_projInvMatrix[i*4+3];
+  }
+
+  m_doc.load_string(a_camNodeText);
+  ReadCommonParamsFromNode(m_doc.child(L"camera"));
+  ReadParamsFromNode(m_doc.child(L"camera"));
+
+  // new render: sample totals, exposure statistics and accumulation state describe the same samples, so they start together
+  //
+  m_sppDone       = 0.0;
+  m_samplesDone   = 0;
+  m_lastFbPointer = nullptr;
+  m_exposure.Clear();
+  m_accum.Reset();
+}
+
+void HostRaysBase::ReadCommonParamsFromNode(pugi::xml_node a_camNode)
+{
+  m_range.ReadFromNode(a_camNode.child(L"distributed"));
+  m_crop.ReadFromNode(a_camNode.child(L"crop"), m_width, m_height);
+  m_reorder.ReadFromNode(a_camNode.child(L"ray_sort"));
+  m_exposure.ReadFromNode(a_camNode.child(L"exposure"));
+  m_accum.ReadFromNode(a_camNode.child(L"accumulation"));
+  m_imageName = m_defaultImageName;
+  if(a_camNode.child(L"output").attribute(L"image") != nullptr)
+    m_imageName = ws2s(a_camNode.child(L"output").attribute(L"image").as_string());
+  m_kernels = SelectHostKernels(a_camNode.child(L"host_isa").text().as_string()); // by CPUID if node is absent
+}
+
+int HostRaysBase::BeginBlock(size_t in_blockSize, int passId)
+{
+  if(m_pipeline[0].size() < in_blockSize)
+  {
+    for(int i=0;i<HOST_RAYS_PIPELINE_LENGTH;i++)
+      m_pipeline[i].resize(in_blockSize);
+  }
+
+  m_globalCounter = m_range.BlockStart(m_blocksDone, in_blockSize);
+  return passId % HOST_RAYS_PIPELINE_LENGTH;
+}
+
+void HostRaysBase::EndBlock(RayPart1* io_rayPosAndNear, RayPart2* io_rayDirAndFar, size_t in_blockSize, int a_putID)
+{
+  // colors come back in the order of rays, so per ray data is permuted with them
+  //
+  m_reorder.Apply(m_kernels, io_rayPosAndNear, io_rayDirAndFar, m_pipeline[a_putID].data(), in_blockSize);
+  m_blocksDone++;
+}
+
+void HostRaysBase::AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId)
+{
+  const int takeID = (passId + HOST_RAYS_PIPELINE_LENGTH - 2) % HOST_RAYS_PIPELINE_LENGTH;
+
+  float* target = m_accum.BlockTarget(out_color4f, a_width, a_height);
+  m_kernels->AddContribution(target, colors4f, m_pipeline[takeID].data(), int(in_blockSize), a_width, a_height);
+  m_accum.EndBlock(m_kernels, out_color4f, colors4f, in_blockSize, a_width, a_height);
+  if(m_exposure.autoExposure)
+  {
+    uint32_t bins[LUM_HIST_BINS];
+    m_kernels->LumHistogram(colors4f, m_pipeline[takeID].data(), int(in_blockSize), bins);
+    m_exposure.AddBlock(bins);
+  }
+
+  m_sppDone      += double(in_blockSize) / m_crop.pixelsNum; // spp inside crop window, pixels outside of it stay black
+  m_samplesDone  += uint64_t(in_blockSize);
+  m_lastFbPointer = out_color4f; // just remember the pointer for demo purposes
+}
+
+void HostRaysBase::FinishRendering()
+{
+  if(m_lastFbPointer == nullptr)
+    return;
+
+  if(!m_range.partialOutput.empty())
+  {
+    const std::string path = ws2s(m_range.partialOutput);
+    if(!SavePartialResult(path.c_str(), m_lastFbPointer, m_width, m_height, m_sppDone, m_samplesDone, &m_exposure))
+      std::cout << "[" << m_name.c_str() << "::FinishRendering]: can't save partial result to " << path.c_str() << std::endl;
+  }
+
+  const float exposure = m_exposure.Scale();
+  if(m_exposure.autoExposure)
+    std::cout << "[" << m_name.c_str() << "::FinishRendering]: average log2 luminance = " << m_exposure.AverageLog2(m_exposure.lowFraction, m_exposure.highFraction) << ", exposure = " << exposure << std::endl;
+
+  ToneMapFramebuffer(m_lastFbPointer, m_width, m_height, m_sppDone,
+                     m_exposure.filmic ? m_kernels->ToneMapFilmic : m_kernels->ToneMap, exposure, &m_finalImage);
+  if(!m_imageName.empty())
+    SaveBMP(m_imageName.c_str(), m_finalImage.data(), m_width, m_height);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+
+#include "CamHostPluginAPI.h"
+
+#include "../HydraCore/hydra_drv/cglobals.h"
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+#include "../HydraAPI/hydra_api/HydraAPI.h"  // for hr_qmc
+
+#include "HostKernels.h"
+#include "DistributedRender.h"
+#include "CropWindow.h"
+#include "RayReorder.h"
+#include "Exposure.h"
+#include "CompensatedAccum.h"
+#include "RaysRecord.h"
+#include "QmcBytes.h"
+
+/**
+  \brief Common state of film cameras: QMC table, sample range, crop window, ray reordering, pipeline ring, accumulation and final image.
+
+  Derived plugin reads its own parameters in ReadParamsFromNode and generates rays in MakeRaysBlock between BeginBlock and EndBlock:
+
+    const int putID = BeginBlock(in_blockSize, passId);
+    m_kernels->MakeRays...(args, out_rayPosAndNear, out_rayDirAndFar, m_pipeline[putID].data(), int(in_blockSize));
+    EndBlock(out_rayPosAndNear, out_rayDirAndFar, in_blockSize, putID);
+*/
+class HostRaysBase : public IHostRaysAPI, public IFinalImageSource
+{
+public:
+  HostRaysBase(const HostKernels* a_kernels, const char* a_name, const char* a_imageName) : m_kernels(a_kernels), m_name(a_name), m_imageName(a_imageName), m_defaultImageName(a_imageName)
+  {
+    hr_qmc::init(table);
+    BuildQmcBytes(&table[0][0], &m_qmcBytes);
+  }
+
+  void SetParameters(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText) override;
+  void AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId) override;
+  void FinishRendering() override;
+
+  /**
+  \brief read parameters of derived plugin; called by SetParameters after film size and common parameters are set
+  */
+  virtual void ReadParamsFromNode(pugi::xml_node a_camNode) = 0;
+
+  /**
+  \brief tonemapped image of the last FinishRendering, m_width*m_height packed 8 bit RGBA; empty before it
+  */
+  const std::vector<uint32_t>& FinalImage() const override { return m_finalImage; }
+
+protected:
+
+  void ReadCommonParamsFromNode(pugi::xml_node a_camNode);
+
+  /**
+  \brief prepare pipeline ring and QMC offset for the next block
+  \return index of pipeline slot for this block
+  */
+  int  BeginBlock(size_t in_blockSize, int passId);
+
+  /**
+  \brief reorder rays of the block if needed and advance block counter
+  */
+  void EndBlock(RayPart1* io_rayPosAndNear, RayPart2* io_rayDirAndFar, size_t in_blockSize, int a_putID);
+
+  pugi::xml_document m_doc;
+  const HostKernels* m_kernels;
+  std::string        m_name;       ///<! for messages
+  std::string        m_imageName;  ///<! final image is saved here in FinishRendering; <output image="..."/> overrides it, empty string disables saving
+  std::string        m_defaultImageName;
+
+  unsigned int table[hr_qmc::QRNG_DIMENSIONS][hr_qmc::QRNG_RESOLUTION];
+  QmcBytes     m_qmcBytes;          ///<! the same QMC for ray generators, see QmcBytes.h
+  uint64_t     m_globalCounter = 0; ///<! Sobol generator takes 32 bit index, so kernels get its low bits (sequence repeats after 2^32 samples of all nodes)
+  unsigned int m_blocksDone    = 0;
+  SampleRange  m_range;
+  CropWindow   m_crop;
+  RayReorder   m_reorder;
+  AutoExposure m_exposure;
+  CompensatedAccum m_accum;
+
+  float    m_fwidth  = 1024.0f;
+  float    m_fheight = 1024.0f;
+  int      m_width   = 1024;
+  int      m_height  = 1024;
+  float4x4 m_projInv;
+
+  double   m_sppDone       = 0.0;
+  uint64_t m_samplesDone   = 0;
+  float*   m_lastFbPointer = nullptr;
+  std::vector<uint32_t> m_finalImage;
+
+  std::vector<PipeThrough> m_pipeline[HOST_RAYS_PIPELINE_LENGTH];
+};
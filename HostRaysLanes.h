@@ -0,0 +1,46 @@
+#pragma once
+
+#include <math.h>
+
+static constexpr int RAY_LANES = 8; ///<! rays processed together by one lane group; 8 floats == one AVX register
+
+/**
+  \brief Concentric mapping of [-0.5,0.5]^2 samples to disc, lane-group version of MapSamplesToDisc from cglobals.h
+  \param a_x    - in  x samples of RAY_LANES size
+  \param a_y    - in  y samples of RAY_LANES size
+  \param out_x  - out disc x of RAY_LANES size
+  \param out_y  - out disc y of RAY_LANES size
+
+  Branches of the scalar version are replaced with selects so the compiler can vectorize the loop;
+  results are the same as calling MapSamplesToDisc(float2(a_x[i], a_y[i])) for each lane.
+*/
+static inline void MapSamplesToDiscLanes(const float* a_x, const float* a_y, float* out_x, float* out_y)
+{
+  #pragma omp simd
+  for(int i=0;i<RAY_LANES;i++)
+  {
+    const float x  = a_x[i];
+    const float y  = a_y[i];
+    const float sx = (x != 0.0f) ? x : 1.0f; // avoid division by zero in branches that are not selected
+    const float sy = (y != 0.0f) ? y : 1.0f; //
+
+    const bool q0 = (x > y && x > -y);
+    const bool q1 = (x < y && x > -y);
+    const bool q2 = (x < y && x < -y);
+    const bool q3 = (x > y && x < -y);
+
+    float r   = 0.0f;
+    float phi = 0.0f;
+    r   = q0 ? x  : r;
+    phi = q0 ? 0.25f*3.141592654f*(y / sx)        : phi;
+    r   = q1 ? y  : r;
+    phi = q1 ? 0.25f*3.141592654f*(2.0f - x / sy) : phi;
+    r   = q2 ? -x : r;
+    phi = q2 ? 0.25f*3.141592654f*(4.0f + y / sx) : phi;
+    r   = q3 ? -y : r;
+    phi = q3 ? 0.25f*3.141592654f*(6.0f - x / sy) : phi;
+
+    out_x[i] = r*sinf(phi);
+    out_y[i] = r*cosf(phi);
+  }
+}
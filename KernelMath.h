@@ -0,0 +1,32 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+/**
+  \brief Vector math for code that is compiled once per instruction set (HostKernels.cpp and headers it includes).
+
+  Only POD types without member functions and static inline functions, so every ISA object file keeps its own copy
+  of each function and linker has nothing to merge; see HostKernels.h. Use it instead of cglobals.h in such code.
+*/
+namespace kmath
+{
+  struct float3 { float x, y, z; };
+
+  static inline float3 make_float3(float a_x, float a_y, float a_z) { float3 res; res.x = a_x; res.y = a_y; res.z = a_z; return res; }
+
+  static inline float3 operator+(const float3 a, const float3 b) { return make_float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+  static inline float3 operator-(const float3 a, const float3 b) { return make_float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+  static inline float3 operator-(const float3 a)                 { return make_float3(-a.x, -a.y, -a.z); }
+  static inline float3 operator*(const float  s, const float3 a) { return make_float3(s*a.x, s*a.y, s*a.z); }
+  static inline float3 operator*(const float3 a, const float  s) { return make_float3(s*a.x, s*a.y, s*a.z); }
+
+  static inline float  dot      (const float3 a, const float3 b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
+  static inline float  length   (const float3 a)                 { return sqrtf(dot(a, a)); }
+  static inline float3 normalize(const float3 a)                 { return a*(1.0f/length(a)); }
+
+  static inline int    as_int    (float a_val)    { int res; memcpy(&res, &a_val, sizeof(int)); return res; }
+  static inline int    packXY1616(int x, int y)   { return (y << 16) | (x & 0x0000FFFF); }
+  static inline int    minInt    (int a, int b)   { return (a < b) ? a : b; }
+};
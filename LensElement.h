@@ -0,0 +1,33 @@
+#pragma once
+
+/**
+  \brief Lens data shared by plugins and kernels; plain structs without vector types, see HostKernels.h about instruction sets.
+*/
+
+struct LensElementInterface
+{
+  float curvatureRadius;
+  float thickness;
+  float eta;
+  float apertureRadius;
+};
+
+/**
+  \brief First order (paraxial) model of lens system. All distances are measured from film along optical axis towards scene.
+  
+  'rear' elements are on film side of lens system, 'front' elements are on scene side.
+*/
+struct ThickLens
+{
+  bool  valid;                ///<! false for afocal or empty lens system and for value-initialized struct
+  float focalLength;          ///<! effective focal length
+  float rearFocalZ;           ///<! rear  focal point
+  float frontFocalZ;          ///<! front focal point
+  float rearPrincipalZ;       ///<! rear  principal plane
+  float frontPrincipalZ;      ///<! front principal plane
+  float entrancePupilZ;       ///<! image of aperture stop seen from scene
+  float entrancePupilRadius;  ///<!
+  float exitPupilZ;           ///<! image of aperture stop seen from film
+  float exitPupilRadius;      ///<!
+  float lensLength;           ///<! from film to the front vertex
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <math.h>
+
+#include "KernelMath.h"
+#include "Aperture.h"
+#include "LensElement.h"
+
+/**
+  \brief Ray tracing through tabular lens system; shared by TableLens and its kernels in HostKernels.cpp, so it uses KernelMath.h.
+*/
+
+static inline float lensMin(float a, float b) { return (a < b) ? a : b; }
+static inline float lensMax(float a, float b) { return (a > b) ? a : b; }
+
+static inline bool Quadratic(float A, float B, float C, float *t0, float *t1) {
+  // Find quadratic discriminant
+  double discrim = (double)B * (double)B - 4. * (double)A * (double)C;
+  if (discrim < 0.)
+    return false;
+  double rootDiscrim = sqrt(discrim);
+  float floatRootDiscrim   = rootDiscrim;
+  //float floatRootDiscrimErr = MachineEpsilon * rootDiscrim;
+  // Compute quadratic _t_ values
+  float q;
+  if ((float)B < 0)
+      q = -.5 * (B - floatRootDiscrim);
+  else
+      q = -.5 * (B + floatRootDiscrim);
+  *t0 = q / A;
+  *t1 = C / q;
+  if ((float)*t0 > (float)*t1)
+  {
+    const float tmp = *t0;
+    *t0 = *t1;
+    *t1 = tmp;
+  }
+  return true;
+}
+
+static inline bool Refract(const kmath::float3 wi, const kmath::float3 n, float eta, kmath::float3 *wt) {
+  // Compute $\cos \theta_\roman{t}$ using Snell's law
+  float cosThetaI  = dot(n, wi);
+  float sin2ThetaI = lensMax(float(0), float(1.0f - cosThetaI * cosThetaI));
+  float sin2ThetaT = eta * eta * sin2ThetaI;
+  // Handle total internal reflection for transmission
+  if (sin2ThetaT >= 1) return false;
+  float cosThetaT = sqrtf(1 - sin2ThetaT);
+  *wt = eta * -wi + (eta * cosThetaI - cosThetaT) * n;
+  return true;
+}
+
+static inline kmath::float3 faceforward(const kmath::float3 n, const kmath::float3 v) { return (dot(n, v) < 0.f) ? -n : n; }
+
+static inline bool IntersectSphericalElement(float radius, float zCenter, const kmath::float3 rayPos, const kmath::float3 rayDir,
+                                             float *t, kmath::float3 *n)
+{
+  // Compute _t0_ and _t1_ for ray--element intersection
+  const kmath::float3 o = rayPos - kmath::make_float3(0, 0, zCenter);
+  const float  A = rayDir.x * rayDir.x + rayDir.y * rayDir.y + rayDir.z * rayDir.z;
+  const float  B = 2 * (rayDir.x * o.x + rayDir.y * o.y + rayDir.z * o.z);
+  const float  C = o.x * o.x + o.y * o.y + o.z * o.z - radius * radius;
+  float  t0, t1;
+  if (!Quadratic(A, B, C, &t0, &t1))
+    return false;
+
+  // Select intersection $t$ based on ray direction and element curvature
+  bool useCloserT = (rayDir.z > 0.0f) ^ (radius < 0.0);
+  *t = useCloserT ? lensMin(t0, t1) : lensMax(t0, t1);
+  if (*t < 0.0f)
+    return false;
+
+  // Compute surface normal of element at ray intersection point
+  *n = normalize(o + (*t)*rayDir);
+  *n = faceforward(*n, -1.0f*rayDir);
+  return true;
+}
+
+/**
+\brief trace ray from film through lens system
+\param a_lines     - lens interfaces, from film to scene
+\param a_linesNum  - number of interfaces
+\param a_aperture  - shape of aperture stop
+\param out_hits    - optional (may be null) hit points, a_linesNum size at most; used for debug
+\param out_hitsNum - optional number of written hit points
+\return false if ray is blocked
+*/
+static inline bool TraceLensesFromFilm(const LensElementInterface* a_lines, int a_linesNum, const ApertureShape* a_aperture,
+                                       const kmath::float3 inRayPos, const kmath::float3 inRayDir, kmath::float3* outRayPos, kmath::float3* outRayDir,
+                                       kmath::float3* out_hits = nullptr, int* out_hitsNum = nullptr)
+{
+  float elementZ = 0;
+  // Transform _rCamera_ from camera to lens system space
+  //
+  kmath::float3 rayPosLens = kmath::make_float3(inRayPos.x, inRayPos.y, -inRayPos.z);
+  kmath::float3 rayDirLens = kmath::make_float3(inRayDir.x, inRayDir.y, -inRayDir.z);
+
+  for(int i=0; i<a_linesNum; i++)
+  {
+    const LensElementInterface& element = a_lines[i];
+    // Update ray from film accounting for interaction with _element_
+    elementZ -= element.thickness;
+
+    // Compute intersection of ray with lens element
+    float t;
+    kmath::float3 n;
+    bool isStop = (element.curvatureRadius == 0.0f);
+    if (isStop)
+    {
+      // The refracted ray computed in the previous lens element
+      // interface may be pointed towards film plane(+z) in some
+      // extreme situations; in such cases, 't' becomes negative.
+      if (rayDirLens.z >= 0.0f)
+        return false;
+      t = (elementZ - rayPosLens.z) / rayDirLens.z;
+    }
+    else
+    {
+      const float radius  = element.curvatureRadius;
+      const float zCenter = elementZ + element.curvatureRadius;
+      if (!IntersectSphericalElement(radius, zCenter, rayPosLens, rayDirLens, &t, &n))
+        return false;
+    }
+
+    // Test intersection point against element aperture
+    const kmath::float3 pHit = rayPosLens + t*rayDirLens;
+    if(out_hits != nullptr)
+      out_hits[(*out_hitsNum)++] = pHit;
+    const float r2    = pHit.x * pHit.x + pHit.y * pHit.y;
+    if (r2 > element.apertureRadius * element.apertureRadius)
+      return false;
+    if (isStop && a_aperture->type != ApertureShape::APERTURE_DISC &&
+        !a_aperture->IsOpen(pHit.x/element.apertureRadius, pHit.y/element.apertureRadius))
+      return false;
+
+    rayPosLens = pHit;
+    // Update ray path for from-scene element interface interaction
+    if (!isStop)
+    {
+      kmath::float3 wt;
+      float etaI = a_lines[i+0].eta;
+      float etaT = (i == a_linesNum-1) ? 1.0f : a_lines[i+1].eta;
+      if(etaT == 0.0f)
+        etaT = 1.0f;
+      if (!Refract(normalize((-1.0f)*rayDirLens), n, etaI / etaT, &wt))
+        return false;
+      rayDirLens = wt;
+    }
+
+  }
+
+  // Transform _rLens_ from lens system space back to camera space
+  //
+  (*outRayPos) = kmath::make_float3(rayPosLens.x, rayPosLens.y, -rayPosLens.z);
+  (*outRayDir) = kmath::make_float3(rayDirLens.x, rayDirLens.y, -rayDirLens.z);
+  return true;
+}
+
+/**
+\brief derive thick lens parameters by paraxial ray transfer matrices through lens system
+\param a_lines    - lens interfaces, from film to scene
+\param a_linesNum - number of interfaces
+
+  Aperture stop is the line with zero curvature; if there is no such line, the element with the smallest aperture is used.
+*/
+static inline ThickLens CalcThickLens(const LensElementInterface* a_lines, int a_linesNum)
+{
+  ThickLens res = {};
+  if(a_linesNum == 0)
+    return res;
+
+  int stopId = -1;
+  for(int i=0;i<a_linesNum;i++)
+  {
+    if(a_lines[i].curvatureRadius == 0.0f)
+    {
+      stopId = i;
+      break;
+    }
+  }
+  if(stopId < 0)
+  {
+    stopId = 0;
+    for(int i=1;i<a_linesNum;i++)
+      if(a_lines[i].apertureRadius < a_lines[stopId].apertureRadius)
+        stopId = i;
+  }
+
+  // state is (height, ior*angle), so every matrix has unit determinant
+  //
+  double M[2][2]     = {{1,0},{0,1}}; ///<! from film to current position
+  double MStop[2][2] = {{1,0},{0,1}}; ///<! from film to aperture stop
+  double z           = 0.0;
+
+  for(int i=0;i<a_linesNum;i++)
+  {
+    const double n = (a_lines[i].eta == 0.0f) ? 1.0 : double(a_lines[i].eta);
+    const double t = double(a_lines[i].thickness)/n;
+    z += double(a_lines[i].thickness);
+    M[0][0] += t*M[1][0];
+    M[0][1] += t*M[1][1];
+
+    if(i == stopId)
+    {
+      MStop[0][0] = M[0][0]; MStop[0][1] = M[0][1];
+      MStop[1][0] = M[1][0]; MStop[1][1] = M[1][1];
+    }
+
+    if(a_lines[i].curvatureRadius != 0.0f)
+    {
+      const double nNext = (i == a_linesNum-1 || a_lines[i+1].eta == 0.0f) ? 1.0 : double(a_lines[i+1].eta);
+      const double power = (nNext - n)/(-double(a_lines[i].curvatureRadius)); // lines are traced towards -z, so radius changes its sign
+      M[1][0] -= power*M[0][0];
+      M[1][1] -= power*M[0][1];
+    }
+  }
+
+  const double A = M[0][0], B = M[0][1], C = M[1][0], D = M[1][1];
+  if(fabs(C) < 1e-12)
+    return res;
+
+  res.valid           = true;
+  res.lensLength      = float(z);
+  res.focalLength     = float(-1.0/C);
+  res.frontFocalZ     = float(z - A/C);
+  res.frontPrincipalZ = float(z + (1.0 - A)/C);
+  res.rearFocalZ      = float(D/C);
+  res.rearPrincipalZ  = float((D - 1.0)/C);
+
+  // stop to front vertex is M*inverse(MStop)
+  //
+  const double SA = MStop[0][0], SB = MStop[0][1];
+  const double FB = -A*SB + B*SA;
+  const double FD = -C*SB + D*SA;
+  const double stopRadius = double(a_lines[stopId].apertureRadius);
+
+  res.entrancePupilZ      = float(z - FB/FD);
+  res.entrancePupilRadius = float(stopRadius/fabs(FD));
+  res.exitPupilZ          = float(SB/SA);
+  res.exitPupilRadius     = float(stopRadius/fabs(SA));
+  return res;
+}
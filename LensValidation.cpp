@@ -0,0 +1,157 @@
+#include "LensValidation.h"
+#include "HashBytes.h"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "../HydraCore/hydra_drv/cglobals.h" // for MapSamplesToDisc
+
+static const int VALIDATION_AZIMUTHS   = 4;  ///<! film points of a zone lay on both sensor diagonals
+static const int VALIDATION_PUPIL_GRID = 32; ///<! rays per film point is VALIDATION_PUPIL_GRID^2
+static const size_t VALIDATION_CACHE_MAX = 64; ///<! cache is cleared when it grows above this; lenses of one scene are much fewer
+
+/**
+  \brief cached result together with its inputs, so a hash collision can't return result of another lens
+*/
+struct LensValidationEntry
+{
+  std::vector<LensElementInterface> lines;
+  uint64_t       apertureHash;
+  float          physSizeX;
+  float          physSizeY;
+  float          focusDistance;
+  LensValidation result;
+
+  bool SameInputs(const std::vector<LensElementInterface>& a_lines, uint64_t a_apertureHash, float a_physSizeX, float a_physSizeY, float a_focusDistance) const
+  {
+    return apertureHash == a_apertureHash && physSizeX == a_physSizeX && physSizeY == a_physSizeY && focusDistance == a_focusDistance &&
+           lines.size() == a_lines.size() && memcmp(lines.data(), a_lines.data(), lines.size()*sizeof(LensElementInterface)) == 0;
+  }
+};
+
+static bool SolveFocusThickness(const std::vector<LensElementInterface>& a_lines, float a_focusDistance, float* out_thickness)
+{
+  const ThickLens lens = CalcThickLens(a_lines.data(), int(a_lines.size()));
+  if(!lens.valid || a_focusDistance <= 0.0f || lens.focalLength <= 0.0f)
+    return false;
+
+  // moving lens system by 'delta' moves both principal planes; object is at distance (span - filmToH) from front one,
+  // film is at 'filmToH' from rear one, so 1/filmToH + 1/(span - filmToH) = 1/f
+  //
+  const double f     = double(lens.focalLength);
+  const double span  = double(a_focusDistance) - double(lens.frontPrincipalZ - lens.rearPrincipalZ);
+  const double discr = span*span - 4.0*f*span;
+  if(span <= 0.0 || discr < 0.0)
+    return false;
+
+  const double filmToH   = 0.5*(span - sqrt(discr)); // the root near focal length; the other one is a macro setup with film far behind lens
+  const double thickness = double(a_lines[0].thickness) + (filmToH - double(lens.rearPrincipalZ));
+  if(thickness <= 0.0)
+    return false;
+
+  (*out_thickness) = float(thickness);
+  return true;
+}
+
+static LensValidation ComputeValidation(const std::vector<LensElementInterface>& a_lines, const ApertureShape& a_aperture,
+                                        float a_physSizeX, float a_physSizeY, float a_focusDistance)
+{
+  LensValidation res;
+  res.rearThickness = a_lines[0].thickness;
+  res.focusSolved   = SolveFocusThickness(a_lines, a_focusDistance, &res.rearThickness);
+
+  std::vector<LensElementInterface> lines = a_lines;
+  lines[0].thickness = res.rearThickness;
+
+  const float rearZ      = lines[0].thickness;
+  const float rearRadius = lines[0].apertureRadius;
+  const int   pupilRays  = VALIDATION_PUPIL_GRID*VALIDATION_PUPIL_GRID;
+  const int   zoneRays   = VALIDATION_AZIMUTHS*pupilRays;
+  const int   totalRays  = LENS_VALIDATION_ZONES*zoneRays;
+
+  std::vector<unsigned char> passed(totalRays);
+
+  #pragma omp parallel for
+  for(int rayId=0; rayId<totalRays; rayId++)
+  {
+    const int zoneId    = rayId / zoneRays;
+    const int azimuthId = (rayId % zoneRays) / pupilRays;
+    const int pupilId   = rayId % pupilRays;
+
+    const float r      = float(zoneId)/float(LENS_VALIDATION_ZONES - 1);
+    const float signX  = (azimuthId & 1) ? -1.0f : 1.0f;
+    const float signY  = (azimuthId & 2) ? -1.0f : 1.0f;
+    const kmath::float3 filmP = kmath::make_float3(signX*r*0.25f*a_physSizeX, signY*r*0.25f*a_physSizeY, 0.0f);
+
+    const float u = (float(pupilId % VALIDATION_PUPIL_GRID) + 0.5f)/float(VALIDATION_PUPIL_GRID);
+    const float v = (float(pupilId / VALIDATION_PUPIL_GRID) + 0.5f)/float(VALIDATION_PUPIL_GRID);
+    const float2 rearSam = rearRadius*2.0f*MapSamplesToDisc(float2(u - 0.5f, v - 0.5f));
+    const kmath::float3 shootTo = kmath::make_float3(rearSam.x, rearSam.y, rearZ);
+
+    kmath::float3 outPos, outDir;
+    passed[rayId] = TraceLensesFromFilm(lines.data(), int(lines.size()), &a_aperture, filmP, normalize(shootTo - filmP), &outPos, &outDir) ? 1 : 0;
+  }
+
+  for(int zoneId=0; zoneId<LENS_VALIDATION_ZONES; zoneId++)
+  {
+    int passedNum = 0;
+    for(int i=zoneId*zoneRays; i<(zoneId+1)*zoneRays; i++)
+      passedNum += int(passed[i]);
+    res.transmission[zoneId] = float(passedNum)/float(zoneRays);
+  }
+
+  return res;
+}
+
+LensValidation ValidateLensSystem(const std::vector<LensElementInterface>& a_lines, const ApertureShape& a_aperture,
+                                  float a_physSizeX, float a_physSizeY, float a_focusDistance, bool* out_fromCache)
+{
+  static std::unordered_map<uint64_t, LensValidationEntry> cache;
+  static std::mutex cacheMutex;
+
+  if(a_lines.empty())
+  {
+    LensValidation empty = {};
+    return empty;
+  }
+
+  const float    params[3]    = {a_physSizeX, a_physSizeY, a_focusDistance};
+  const uint64_t apertureHash = a_aperture.Hash(HASH_SEED);
+  uint64_t key = HashBytes(a_lines.data(), a_lines.size()*sizeof(LensElementInterface), HASH_SEED);
+  key          = HashBytes(params, sizeof(params), key);
+  key          = HashBytes(&apertureHash, sizeof(apertureHash), key);
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto p = cache.find(key);
+    if(p != cache.end() && p->second.SameInputs(a_lines, apertureHash, a_physSizeX, a_physSizeY, a_focusDistance))
+    {
+      if(out_fromCache != nullptr)
+        (*out_fromCache) = true;
+      return p->second.result;
+    }
+  }
+
+  // computed without lock; if two threads validate the same lens, both results are equal
+  //
+  const LensValidation res = ComputeValidation(a_lines, a_aperture, a_physSizeX, a_physSizeY, a_focusDistance);
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.size() >= VALIDATION_CACHE_MAX && cache.find(key) == cache.end())
+      cache.clear();
+
+    LensValidationEntry& entry = cache[key]; // on collision the older entry is replaced
+    entry.lines         = a_lines;
+    entry.apertureHash  = apertureHash;
+    entry.physSizeX     = a_physSizeX;
+    entry.physSizeY     = a_physSizeY;
+    entry.focusDistance = a_focusDistance;
+    entry.result        = res;
+  }
+
+  if(out_fromCache != nullptr)
+    (*out_fromCache) = false;
+  return res;
+}
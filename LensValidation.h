@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "LensTrace.h"
+#include "Aperture.h"
+
+static const int LENS_VALIDATION_ZONES = 5; ///<! film points from sensor center to corner
+
+/**
+  \brief Result of validation of lens system by batch of real rays and optional focus solve.
+*/
+struct LensValidation
+{
+  float transmission[LENS_VALIDATION_ZONES]; ///<! fraction of rays aimed from film point at rear element that leave lens system; from center to corner
+  float rearThickness;                       ///<! distance from sensor to rear element that focuses at 'focusDistance'
+  bool  focusSolved;                         ///<! false if focus was not requested or has no solution; 'rearThickness' is the original one then
+};
+
+/**
+\brief trace validation rays and solve focus; results are cached by prescription, aperture hash, sensor size and focus distance
+\param a_lines         - lens interfaces, from film to scene
+\param a_aperture      - shape of aperture stop
+\param a_physSizeX     - film size, film point is 0.25*physSize*(2*s - 1) for s in [0,1] as in MakeRaysLens
+\param a_physSizeY     -
+\param a_focusDistance - distance from sensor to plane in focus; 0 means do not focus
+\param out_fromCache   - optional; true if result was taken from cache
+
+  Focus is solved with paraxial thick lens model by moving the whole lens system along axis; validation rays are traced through the focused system.
+  Safe to call from several threads.
+*/
+LensValidation ValidateLensSystem(const std::vector<LensElementInterface>& a_lines, const ApertureShape& a_aperture,
+                                  float a_physSizeX, float a_physSizeY, float a_focusDistance, bool* out_fromCache = nullptr);
@@ -0,0 +1,101 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include "DistributedRender.h"
+#include "Tonemap.h"
+
+/**
+  \brief Merge partial results of several render nodes into one image; it equals single node render up to float rounding.
+
+    hydra_merge_partials -out z_merged.hpart [-bmp z_merged.bmp] z_part_0.hpart z_part_1.hpart ...
+
+  Each node must render disjoint slice of QMC sequence with <distributed offset="k" stride="N" partial_output="..."/>.
+  Framebuffers and sample totals are summed; summation is done in double, so the order of inputs does not matter.
+  Luminance histograms are summed too, so auto exposure of merged image is metered from samples of all nodes;
+  exposure settings are taken from the first partial.
+*/
+int main(int argc, const char** argv)
+{
+  std::string outPart, outBmp;
+  std::vector<std::string> inputs;
+  for(int i=1;i<argc;i++)
+  {
+    if(std::strcmp(argv[i], "-out") == 0 && i+1 < argc)
+      outPart = argv[++i];
+    else if(std::strcmp(argv[i], "-bmp") == 0 && i+1 < argc)
+      outBmp = argv[++i];
+    else
+      inputs.push_back(argv[i]);
+  }
+
+  if(inputs.empty() || (outPart.empty() && outBmp.empty()))
+  {
+    std::cout << "usage: hydra_merge_partials -out merged.hpart [-bmp merged.bmp] part0.hpart part1.hpart ..." << std::endl;
+    return 1;
+  }
+
+  PartialResult       part;
+  std::vector<double> summ;
+  int    width   = 0;
+  int    height  = 0;
+  double sppDone = 0.0;
+  uint64_t samples = 0;
+  AutoExposure exposure;
+
+  for(const auto& path : inputs)
+  {
+    if(!LoadPartialResult(path.c_str(), &part))
+    {
+      std::cout << "[hydra_merge_partials]: can't load partial result " << path.c_str() << std::endl;
+      return 2;
+    }
+
+    if(summ.empty())
+    {
+      width  = part.width;
+      height = part.height;
+      summ.resize(part.color.size(), 0.0);
+      exposure = part.exposure;
+      exposure.Clear();
+    }
+    else if(part.width != width || part.height != height)
+    {
+      std::cout << "[hydra_merge_partials]: " << path.c_str() << " has size " << part.width << "x" << part.height
+                << ", expected " << width << "x" << height << std::endl;
+      return 3;
+    }
+
+    #pragma omp parallel for
+    for(int i=0;i<int(summ.size());i++)
+      summ[i] += double(part.color[i]);
+
+    sppDone += part.sppDone;
+    samples += part.samples;
+    exposure.Merge(part.exposure);
+    std::cout << "[hydra_merge_partials]: " << path.c_str() << ", spp = " << part.sppDone << std::endl;
+  }
+
+  std::vector<float> merged(summ.size());
+  for(size_t i=0;i<summ.size();i++)
+    merged[i] = float(summ[i]);
+
+  std::cout << "[hydra_merge_partials]: merged " << inputs.size() << " partials, spp = " << sppDone << ", rays = " << samples << std::endl;
+
+  if(!outPart.empty() && !SavePartialResult(outPart.c_str(), merged.data(), width, height, sppDone, samples, &exposure))
+  {
+    std::cout << "[hydra_merge_partials]: can't save " << outPart.c_str() << std::endl;
+    return 4;
+  }
+
+  if(!outBmp.empty())
+  {
+    const float scale = exposure.Scale();
+    if(exposure.autoExposure)
+      std::cout << "[hydra_merge_partials]: average log2 luminance = " << exposure.AverageLog2(exposure.lowFraction, exposure.highFraction) << ", exposure = " << scale << std::endl;
+    SaveFramebufferBMP(outBmp.c_str(), merged.data(), width, height, sppDone, exposure.filmic ? &ToneMapPixelsFilmic : &ToneMapPixels, scale);
+  }
+
+  return 0;
+}
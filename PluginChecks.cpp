@@ -0,0 +1,919 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <codecvt>
+#include <locale>
+
+#include "../HydraCore/hydra_drv/cglobals.h"
+#include "../HydraAPI/hydra_api/HydraAPI.h"
+
+#include "HostKernels.h"
+#include "LensValidation.h"
+#include "Aperture.h"
+#include "HostRaysLanes.h"
+#include "CropWindow.h"
+#include "CompensatedAccum.h"
+#include "DistributedRender.h"
+#include "RaysRecord.h"
+#include "QmcBytes.h"
+
+/**
+  \brief Behaviour checks of plugin parts that do not need Hydra: lens solve, ray sort, aperture sampling, partial merge,
+         capture round trip and compensated accumulation. Kernel checks run for every instruction set this CPU supports.
+
+    hydra_cam_checks                          - run checks; exit code is the number of failed ones
+    hydra_cam_checks -bench [blockSize] [n]   - time SimpleDOF ray generation: scalar EyeRayDir loop against MakeRaysDOF kernels,
+                                                with QMC byte tables and with hr_qmc::rndFloat
+
+  Registered in ctest; whole sessions are checked with hydra_cam_replay, see HYDRA_CAM_REPLAY_SESSION in CMakeLists.txt.
+*/
+
+std::string ws2s(const std::wstring& wstr)
+{
+  std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converterX;
+  return converterX.to_bytes(wstr);
+}
+
+struct CheckLog
+{
+  CheckLog(const char* a_name) : name(a_name) { }
+
+  void Expect(bool a_cond, const std::string& a_what)
+  {
+    if(a_cond)
+      return;
+    std::cout << "[hydra_cam_checks]: " << name << ": FAILED, " << a_what.c_str() << std::endl;
+    failed++;
+  }
+
+  int Report() const
+  {
+    if(failed == 0)
+      std::cout << "[hydra_cam_checks]: " << name << ": ok" << std::endl;
+    return (failed == 0) ? 0 : 1;
+  }
+
+  const char* name;
+  int failed = 0;
+};
+
+/**
+\brief kernels of every instruction set supported by this CPU, generic first
+*/
+static std::vector<const HostKernels*> SupportedKernels()
+{
+  const wchar_t* names[4] = {L"generic", L"sse42", L"avx2", L"avx512"};
+  std::vector<const HostKernels*> res;
+  for(int i=0;i<4;i++)
+  {
+    const HostKernels* pKernels = SelectHostKernels(names[i]);
+    if(ws2s(names[i]) == pKernels->name && std::find(res.begin(), res.end(), pKernels) == res.end())
+      res.push_back(pKernels);
+  }
+  return res;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+\brief biconvex singlet, radii 50, center thickness 5, ior 1.5; lines go from film to scene as in TableLens
+*/
+static std::vector<LensElementInterface> SingletLens(float a_filmToLens)
+{
+  std::vector<LensElementInterface> lines(2);
+  lines[0].curvatureRadius = -50.0f; lines[0].thickness = a_filmToLens; lines[0].eta = 1.0f; lines[0].apertureRadius = 10.0f;
+  lines[1].curvatureRadius = +50.0f; lines[1].thickness = 5.0f;         lines[1].eta = 1.5f; lines[1].apertureRadius = 10.0f;
+  return lines;
+}
+
+/**
+\brief axial distance from film to the image of film center, by paraxial (height, ior*angle) trace; independent of principal planes
+*/
+static double ParaxialConjugate(const std::vector<LensElementInterface>& a_lines)
+{
+  double h = 0.0, nu = 1e-3, z = 0.0;
+  for(size_t i=0;i<a_lines.size();i++)
+  {
+    const double n = (a_lines[i].eta == 0.0f) ? 1.0 : double(a_lines[i].eta);
+    h += double(a_lines[i].thickness)*nu/n;
+    z += double(a_lines[i].thickness);
+    const double nNext = (i+1 == a_lines.size() || a_lines[i+1].eta == 0.0f) ? 1.0 : double(a_lines[i+1].eta);
+    nu -= (nNext - n)/(-double(a_lines[i].curvatureRadius))*h;
+  }
+  return z - h/nu;
+}
+
+static int CheckLensSolve()
+{
+  CheckLog log("lens solve");
+
+  const std::vector<LensElementInterface> lines = SingletLens(50.0f);
+  const ThickLens lens = CalcThickLens(lines.data(), int(lines.size()));
+
+  // lensmaker's equation for thick lens, R1 = 50, R2 = -50 in the usual sign convention
+  //
+  const double n = 1.5, R1 = 50.0, R2 = -50.0, d = 5.0;
+  const double fRef = 1.0/((n - 1.0)*(1.0/R1 - 1.0/R2 + (n - 1.0)*d/(n*R1*R2)));
+  log.Expect(lens.valid, "singlet is afocal");
+  log.Expect(std::fabs(double(lens.focalLength) - fRef) < 1e-4*fRef, "focal length " + std::to_string(lens.focalLength) + ", expected " + std::to_string(fRef));
+
+  ApertureShape disc;
+  const float focusDistance = 1000.0f;
+  bool fromCache = true;
+  const LensValidation check = ValidateLensSystem(lines, disc, 10.0f, 10.0f, focusDistance, &fromCache);
+  log.Expect(!fromCache, "first validation is taken from cache");
+  log.Expect(check.focusSolved, "focus at 1000 is not solved");
+
+  std::vector<LensElementInterface> focused = lines;
+  focused[0].thickness = check.rearThickness;
+  const double conjugate = ParaxialConjugate(focused);
+  log.Expect(std::fabs(conjugate - double(focusDistance)) < 1e-3*double(focusDistance), "focused lens images film at " + std::to_string(conjugate));
+  log.Expect(check.rearThickness < float(2.0*fRef), "focus is solved with film far behind lens, rear thickness " + std::to_string(check.rearThickness));
+  log.Expect(check.transmission[0] > 0.0f, "no rays pass singlet from sensor center");
+
+  const LensValidation again = ValidateLensSystem(lines, disc, 10.0f, 10.0f, focusDistance, &fromCache);
+  log.Expect(fromCache, "the same lens is validated again");
+  log.Expect(std::memcmp(&again, &check, sizeof(LensValidation)) == 0, "cached result differs");
+
+  const LensValidation close = ValidateLensSystem(lines, disc, 10.0f, 10.0f, 100.0f, &fromCache);
+  log.Expect(!fromCache, "other focus distance is taken from cache");
+  log.Expect(!close.focusSolved && close.rearThickness == lines[0].thickness, "focus closer than 4f is solved");
+
+  return log.Report();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CheckSortRays(const std::vector<const HostKernels*>& a_kernels)
+{
+  CheckLog log("ray sort");
+
+  const int N = 10007; // not a multiple of RAY_SORT_CHUNKS
+  std::vector<RayPart1>    part1(N);
+  std::vector<RayPart2>    part2(N);
+  std::vector<PipeThrough> pipeline(N);
+
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<float> rnd(-1.0f, 1.0f);
+  for(int i=0;i<N;i++)
+  {
+    const float3 dir = normalize(float3(rnd(gen), rnd(gen), rnd(gen)));
+    part1[i].origin[0]    = 8.0f + 8.0f*rnd(gen);
+    part1[i].origin[1]    = 8.0f + 8.0f*rnd(gen);
+    part1[i].origin[2]    = 8.0f + 8.0f*rnd(gen);
+    part1[i].xyPosPacked  = (i % 7 == 3) ? 0xFFFFFFFF : uint32_t(i);
+    part2[i].direction[0] = dir.x;
+    part2[i].direction[1] = dir.y;
+    part2[i].direction[2] = dir.z;
+    part2[i].dummy        = 0.0f;
+    pipeline[i].cosPower4   = 1.0f;
+    pipeline[i].packedIndex = uint32_t(i); // original position of ray
+  }
+
+  // the largest possible live key: origin at box corner, direction quantized to maximum in every component;
+  // box is [0,16]^3, so origin is quantized without rounding
+  //
+  for(int k=0;k<3;k++)
+  {
+    part1[0].origin[k]      = 0.0f;
+    part1[N-1].origin[k]    = 16.0f;
+    part2[N-1].direction[k] = 1.0f;
+  }
+  part1[N-1].xyPosPacked = uint32_t(N-1);
+
+  std::vector<uint32_t> keys(N), keysTmp(N), index(N), indexTmp(N), histogram(RAY_SORT_CHUNKS*256);
+  std::vector<RayPart1> tmpPart1(N);
+  std::vector<RayPart2> tmpPart2(N);
+  std::vector<PipeThrough> tmpPipeline(N);
+
+  RaySortArgs args;
+  args.keys        = keys.data();
+  args.keysTmp     = keysTmp.data();
+  args.index       = index.data();
+  args.indexTmp    = indexTmp.data();
+  args.histogram   = histogram.data();
+  args.tmpPart1    = tmpPart1.data();
+  args.tmpPart2    = tmpPart2.data();
+  args.tmpPipeline = tmpPipeline.data();
+
+  const RAY_SORT_MODE modes[2] = {RAY_SORT_OCTANT, RAY_SORT_HASH};
+  for(int modeId=0; modeId<2; modeId++)
+  {
+    std::vector<RayPart1> first1;
+    std::vector<RayPart2> first2;
+    for(auto pKernels : a_kernels)
+    {
+      const std::string what = std::string(pKernels->name) + ((modes[modeId] == RAY_SORT_OCTANT) ? " octant" : " hash");
+      std::vector<RayPart1>    sorted1  = part1;
+      std::vector<RayPart2>    sorted2  = part2;
+      std::vector<PipeThrough> sortedP  = pipeline;
+      args.mode = modes[modeId];
+      pKernels->SortRays(args, sorted1.data(), sorted2.data(), sortedP.data(), N);
+
+      std::vector<int> seen(N, 0);
+      bool sameRays = true, deadAtEnd = true, stable = true;
+      uint32_t prevKey = 0, prevId = 0;
+      for(int i=0;i<N;i++)
+      {
+        const uint32_t j = sortedP[i].packedIndex;
+        if(j >= uint32_t(N) || seen[j]++ != 0)
+        {
+          sameRays = false;
+          break;
+        }
+        sameRays = sameRays && std::memcmp(&sorted1[i], &part1[j], sizeof(RayPart1)) == 0 && std::memcmp(&sorted2[i], &part2[j], sizeof(RayPart2)) == 0;
+        if(i > 0 && sorted1[i-1].xyPosPacked == 0xFFFFFFFF && sorted1[i].xyPosPacked != 0xFFFFFFFF)
+          deadAtEnd = false;
+
+        const float* d = sorted2[i].direction;
+        const uint32_t key = (sorted1[i].xyPosPacked == 0xFFFFFFFF) ? 8u : ((d[0] < 0.0f ? 1u : 0u) | (d[1] < 0.0f ? 2u : 0u) | (d[2] < 0.0f ? 4u : 0u));
+        if(modes[modeId] == RAY_SORT_OCTANT && i > 0 && (key < prevKey || (key == prevKey && j < prevId)))
+          stable = false;
+        prevKey = key;
+        prevId  = j;
+      }
+
+      log.Expect(sameRays,  what + ": rays and pipeline are not permuted together");
+      log.Expect(deadAtEnd, what + ": dead rays are not at the end");
+      log.Expect(stable,    what + ": octant keys are not sorted stably");
+
+      if(first1.empty())
+      {
+        first1 = sorted1;
+        first2 = sorted2;
+      }
+      else
+        log.Expect(std::memcmp(first1.data(), sorted1.data(), N*sizeof(RayPart1)) == 0 && std::memcmp(first2.data(), sorted2.data(), N*sizeof(RayPart2)) == 0,
+                   what + ": order differs from " + a_kernels[0]->name);
+    }
+  }
+
+  return log.Report();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+\brief aperture with shape set directly instead of <aperture> node
+*/
+struct ApertureForCheck : public ApertureShape
+{
+  void SetMask(const std::vector<float>& a_mask, int a_width, int a_height)
+  {
+    m_mask  = a_mask;
+    m_maskW = a_width;
+    m_maskH = a_height;
+    BuildAliasTable(m_mask);
+    type = APERTURE_MASK;
+  }
+
+  void SetPolygon(int a_blades, float a_rotation)
+  {
+    blades   = a_blades;
+    rotation = a_rotation;
+    BuildPolygon();
+    type = APERTURE_POLYGON;
+  }
+};
+
+static int CheckApertureSampling()
+{
+  CheckLog log("aperture sampling");
+
+  const int W = 4, H = 2;
+  const std::vector<float> mask = {0.0f, 1.0f, 0.5f, 0.25f,
+                                   1.0f, 0.0f, 0.75f, 0.5f};
+  ApertureForCheck aperture;
+  aperture.SetMask(mask, W, H);
+  log.Expect(aperture.NeedsJitter(), "mask does not need jitter");
+
+  // stratified 'u' selects pixels exactly in proportion; 'w' and 'v' are positions inside pixel along x and y
+  //
+  const int samplesNum = 1 << 16;
+  std::vector<int> count(W*H, 0);
+  float jitterDiff = 0.0f;
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<float> rnd(0.0f, 1.0f);
+  for(int start=0; start<samplesNum; start+=RAY_LANES)
+  {
+    alignas(32) float u[RAY_LANES], v[RAY_LANES], w[RAY_LANES], x[RAY_LANES], y[RAY_LANES];
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      u[i] = (float(start + i) + 0.5f)/float(samplesNum);
+      v[i] = rnd(gen);
+      w[i] = rnd(gen);
+    }
+    aperture.SampleLanes(u, v, w, x, y);
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      const float px = 0.5f*(x[i] + 1.0f)*float(W);
+      const float py = 0.5f*(y[i] + 1.0f)*float(H);
+      count[std::min(int(py), H-1)*W + std::min(int(px), W-1)]++;
+      jitterDiff = std::max(jitterDiff, std::max(std::fabs(px - std::floor(px) - w[i]), std::fabs(py - std::floor(py) - v[i])));
+    }
+  }
+
+  double summ = 0.0;
+  for(auto m : mask)
+    summ += double(m);
+  for(int i=0;i<W*H;i++)
+  {
+    const double expected = double(mask[i])/summ;
+    const double got      = double(count[i])/double(samplesNum);
+    log.Expect(std::fabs(got - expected) < 1e-3, "pixel " + std::to_string(i) + " gets " + std::to_string(got) + " of samples, expected " + std::to_string(expected));
+  }
+  log.Expect(jitterDiff < 1e-4f, "position inside mask pixel differs from (w,v) by " + std::to_string(jitterDiff));
+
+  // polygon: every sample is inside, and centrally symmetric shape gets half of samples on each side
+  //
+  aperture.SetPolygon(6, 0.3f);
+  int inside = 0, right = 0;
+  for(int start=0; start<samplesNum; start+=RAY_LANES)
+  {
+    alignas(32) float u[RAY_LANES], v[RAY_LANES], w[RAY_LANES], x[RAY_LANES], y[RAY_LANES];
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      u[i] = rnd(gen);
+      v[i] = rnd(gen);
+      w[i] = 0.5f;
+    }
+    aperture.SampleLanes(u, v, w, x, y);
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      inside += aperture.IsOpen(0.999f*x[i], 0.999f*y[i]) ? 1 : 0;
+      right  += (x[i] > 0.0f) ? 1 : 0;
+    }
+  }
+  log.Expect(inside == samplesNum, std::to_string(samplesNum - inside) + " polygon samples are outside of polygon");
+  log.Expect(std::fabs(double(right)/samplesNum - 0.5) < 0.01, "polygon samples are not symmetric");
+
+  // disc is the same as MapSamplesToDisc of old SimpleDOF
+  //
+  ApertureShape disc;
+  float maxDiff = 0.0f;
+  for(int start=0; start<4096; start+=RAY_LANES)
+  {
+    alignas(32) float u[RAY_LANES], v[RAY_LANES], w[RAY_LANES], x[RAY_LANES], y[RAY_LANES];
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      u[i] = rnd(gen);
+      v[i] = rnd(gen);
+      w[i] = 0.5f;
+    }
+    disc.SampleLanes(u, v, w, x, y);
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      const float2 ref = 2.0f*MapSamplesToDisc(float2(u[i] - 0.5f, v[i] - 0.5f));
+      maxDiff = std::max(maxDiff, std::max(std::fabs(ref.x - x[i]), std::fabs(ref.y - y[i])));
+    }
+  }
+  log.Expect(maxDiff < 1e-5f, "disc differs from MapSamplesToDisc by " + std::to_string(maxDiff));
+
+  return log.Report();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+\brief block of samples with colors and packed pixels as Hydra returns them; every 13th ray is dead, every 5th sample is black
+*/
+static std::vector<float> MakeColors(int a_blockId, int a_blockSize, int a_width, int a_height)
+{
+  std::vector<float> colors(size_t(a_blockSize)*4);
+  std::mt19937 gen(1000 + a_blockId);
+  std::uniform_int_distribution<int>    px(0, a_width-1), py(0, a_height-1);
+  std::uniform_real_distribution<float> rnd(0.0f, 1.0f);
+  for(int i=0;i<a_blockSize;i++)
+  {
+    const bool     dead   = (i % 13 == 5);
+    const uint32_t packed = dead ? 0xFFFFFFFF : (uint32_t(py(gen)) << 16) | uint32_t(px(gen));
+    const float    scale  = (i % 5 == 0) ? 0.0f : 4.0f; // black samples
+    colors[i*4+0] = scale*rnd(gen);
+    colors[i*4+1] = scale*rnd(gen);
+    colors[i*4+2] = scale*rnd(gen);
+    colors[i*4+3] = as_float(int(packed));
+  }
+  return colors;
+}
+
+static int CheckPartialMerge(const HostKernels* a_kernels)
+{
+  CheckLog log("partial merge");
+
+  const int W = 37, H = 23, blockSize = 1000, blocksNum = 12, nodesNum = 3;
+
+  std::vector<float> single(W*H*4, 0.0f);
+  AutoExposure singleExp;
+  std::vector<uint32_t> bins(LUM_HIST_BINS);
+  for(int blockId=0; blockId<blocksNum; blockId++)
+  {
+    const std::vector<float> colors = MakeColors(blockId, blockSize, W, H);
+    a_kernels->AddContribution(single.data(), colors.data(), nullptr, blockSize, W, H);
+    a_kernels->LumHistogram(colors.data(), nullptr, blockSize, bins.data());
+    singleExp.AddBlock(bins.data());
+  }
+
+  std::vector<double> merged(W*H*4, 0.0);
+  std::vector<int>    covered(blocksNum, 0);
+  double   sppDone = 0.0;
+  uint64_t samples = 0;
+  AutoExposure mergedExp;
+  for(int nodeId=0; nodeId<nodesNum; nodeId++)
+  {
+    SampleRange range;
+    range.offset = nodeId;
+    range.stride = nodesNum;
+
+    std::vector<float> color(W*H*4, 0.0f);
+    AutoExposure exposure;
+    const int localBlocks = blocksNum/nodesNum;
+    for(int localId=0; localId<localBlocks; localId++)
+    {
+      const uint64_t start = range.BlockStart(localId, blockSize);
+      const int blockId    = int(start/blockSize);
+      log.Expect(start % blockSize == 0 && blockId < blocksNum, "BlockStart is out of single node range");
+      if(blockId >= blocksNum)
+        continue;
+      covered[blockId]++;
+      const std::vector<float> colors = MakeColors(blockId, blockSize, W, H);
+      a_kernels->AddContribution(color.data(), colors.data(), nullptr, blockSize, W, H);
+      a_kernels->LumHistogram(colors.data(), nullptr, blockSize, bins.data());
+      exposure.AddBlock(bins.data());
+    }
+
+    const std::string fname = "z_checks_part_" + std::to_string(nodeId) + ".hpart";
+    const double nodeSpp = double(localBlocks*blockSize)/double(W*H);
+    log.Expect(SavePartialResult(fname.c_str(), color.data(), W, H, nodeSpp, uint64_t(localBlocks*blockSize), &exposure), "can't save " + fname);
+
+    PartialResult part;
+    log.Expect(LoadPartialResult(fname.c_str(), &part), "can't load " + fname);
+    std::remove(fname.c_str());
+    if(part.color.size() != color.size())
+      return log.Report();
+
+    log.Expect(part.width == W && part.height == H && part.sppDone == nodeSpp && part.samples == uint64_t(localBlocks*blockSize), fname + " header changed");
+    log.Expect(std::memcmp(part.color.data(), color.data(), color.size()*sizeof(float)) == 0, fname + " image changed");
+    log.Expect(std::memcmp(part.exposure.histogram, exposure.histogram, sizeof(exposure.histogram)) == 0, fname + " histogram changed");
+
+    for(size_t i=0;i<merged.size();i++) // the same as hydra_merge_partials
+      merged[i] += double(part.color[i]);
+    sppDone += part.sppDone;
+    samples += part.samples;
+    mergedExp.Merge(part.exposure);
+  }
+
+  for(int blockId=0; blockId<blocksNum; blockId++)
+    log.Expect(covered[blockId] == 1, "block " + std::to_string(blockId) + " is rendered by " + std::to_string(covered[blockId]) + " nodes");
+
+  double maxDiff = 0.0;
+  for(size_t i=0;i<merged.size();i++)
+    maxDiff = std::max(maxDiff, std::fabs(merged[i] - double(single[i]))/std::max(1.0, double(single[i])));
+  log.Expect(maxDiff < 1e-5, "merged image differs from single node by " + std::to_string(maxDiff));
+  log.Expect(samples == uint64_t(blocksNum*blockSize) && std::fabs(sppDone - double(blocksNum*blockSize)/double(W*H)) < 1e-9, "sample totals differ");
+  log.Expect(std::memcmp(mergedExp.histogram, singleExp.histogram, sizeof(singleExp.histogram)) == 0, "merged histogram differs from single node");
+
+  uint64_t histTotal = 0;
+  for(int b=0;b<LUM_HIST_BINS;b++)
+    histTotal += singleExp.histogram[b];
+  log.Expect(histTotal == uint64_t(blocksNum*(blockSize - (blockSize + 7)/13)), "histogram has " + std::to_string(histTotal) + " samples, dead rays are counted or black ones are not");
+
+  return log.Report();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+\brief deterministic plugin: rays and final image depend only on call order
+*/
+class PluginForCheck : public IHostRaysAPI, public IFinalImageSource
+{
+public:
+  void MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId) override
+  {
+    for(size_t i=0;i<in_blockSize;i++)
+      FillRay(m_counter + i, passId, &out_rayPosAndNear[i], &out_rayDirAndFar[i]);
+    m_counter += in_blockSize;
+  }
+
+  void AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId) override
+  {
+    for(size_t i=0;i<in_blockSize;i++)
+      out_color4f[(i % (size_t(a_width)*size_t(a_height)))*4] += colors4f[i*4];
+    m_width  = a_width;
+    m_height = a_height;
+  }
+
+  void FinishRendering() override
+  {
+    m_image.resize(size_t(m_width)*size_t(m_height));
+    for(size_t i=0;i<m_image.size();i++)
+      m_image[i] = uint32_t(i*2654435761u);
+  }
+
+  const std::vector<uint32_t>& FinalImage() const override { return m_image; }
+
+  static void FillRay(size_t a_rayId, int a_passId, RayPart1* out_p1, RayPart2* out_p2)
+  {
+    out_p1->origin[0]    = float(a_rayId);
+    out_p1->origin[1]    = float(a_passId);
+    out_p1->origin[2]    = 0.5f;
+    out_p1->xyPosPacked  = uint32_t(a_rayId*7);
+    out_p2->direction[0] = 0.0f;
+    out_p2->direction[1] = 0.0f;
+    out_p2->direction[2] = -1.0f;
+    out_p2->dummy        = float(a_rayId % 3);
+  }
+
+  size_t   m_counter = 0;
+  uint32_t m_width   = 0;
+  uint32_t m_height  = 0;
+  std::vector<uint32_t> m_image;
+};
+
+static int CheckRecordRoundTrip()
+{
+  CheckLog log("capture round trip");
+
+  const char*    path    = "z_checks_session.hrec";
+  const wchar_t* camText = L"<camera name=\"check\"><capture path=\"z_checks_session.hrec\" rays=\"1\" blocks=\"1\" /></camera>";
+  const int W = 7, H = 5, blockSize = 100;
+  float projInv[16];
+  for(int i=0;i<16;i++)
+    projInv[i] = float(i) - 0.25f;
+
+  // two renders of one plugin instance: 2 blocks, then 1 block; the second session is appended
+  //
+  const int sessionBlocks[2] = {2, 1};
+  std::vector<float>    framebuffer(W*H*4, 0.0f);
+  std::vector<RayPart1> part1(blockSize);
+  std::vector<RayPart2> part2(blockSize);
+  PluginForCheck* pPlugin   = new PluginForCheck;
+  IHostRaysAPI*   pRecorder = MakeRaysRecorder(pPlugin, pPlugin);
+  for(int sessionId=0; sessionId<2; sessionId++)
+  {
+    pRecorder->SetParameters(W, H, projInv, camText);
+    for(int passId=0; passId<sessionBlocks[sessionId]; passId++)
+    {
+      pRecorder->MakeRaysBlock(part1.data(), part2.data(), blockSize, passId);
+      const std::vector<float> colors = MakeColors(passId, blockSize, W, H);
+      pRecorder->AddSamplesContribution(framebuffer.data(), colors.data(), blockSize, W, H, passId);
+    }
+    pRecorder->FinishRendering();
+  }
+  delete pRecorder;
+
+  RaysRecordReader reader;
+  log.Expect(reader.Open(path), "can't open captured session");
+  if(reader.Header() == nullptr)
+    return log.Report();
+
+  log.Expect(std::memcmp(reader.Header()->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) == 0 && reader.Header()->version == RECORD_VERSION, "wrong file header");
+  log.Expect(reader.Header()->width == W && reader.Header()->height == H && std::memcmp(reader.Header()->projInv, projInv, sizeof(projInv)) == 0, "wrong SetParameters arguments");
+  log.Expect(reader.CameraText().find("check") != std::string::npos && reader.CameraText().find("capture") == std::string::npos, "camera text is not stored without <capture>");
+
+  std::vector<uint32_t> expected;
+  for(int sessionId=0; sessionId<2; sessionId++)
+  {
+    if(sessionId > 0)
+      expected.push_back(RECORD_SET_PARAMETERS);
+    for(int passId=0; passId<sessionBlocks[sessionId]; passId++)
+    {
+      expected.push_back(RECORD_MAKE_RAYS);
+      expected.push_back(RECORD_ADD_CONTRIB);
+    }
+    expected.push_back(RECORD_FRAMEBUFFER);
+    expected.push_back(RECORD_FINISH);
+    expected.push_back(RECORD_IMAGE);
+  }
+
+  const RecordHeader* pHeader  = nullptr;
+  const uint8_t*      pPayload = nullptr;
+  size_t recordId = 0, rayId = 0;
+  bool   payloadsOk = true;
+  while(reader.Next(&pHeader, &pPayload))
+  {
+    if(recordId >= expected.size() || pHeader->type != expected[recordId])
+    {
+      log.Expect(false, "record " + std::to_string(recordId) + " has type " + std::to_string(pHeader->type));
+      break;
+    }
+
+    if(pHeader->type == RECORD_MAKE_RAYS)
+    {
+      payloadsOk = payloadsOk && (pHeader->payloadBytes == blockSize*(sizeof(RayPart1) + sizeof(RayPart2)));
+      const RayPart1* rays1 = (const RayPart1*)pPayload;
+      const RayPart2* rays2 = (const RayPart2*)(pPayload + blockSize*sizeof(RayPart1));
+      for(int i=0; i<blockSize && payloadsOk; i++, rayId++)
+      {
+        RayPart1 p1; RayPart2 p2;
+        PluginForCheck::FillRay(rayId, pHeader->passId, &p1, &p2);
+        payloadsOk = std::memcmp(&p1, &rays1[i], sizeof(RayPart1)) == 0 && std::memcmp(&p2, &rays2[i], sizeof(RayPart2)) == 0;
+      }
+    }
+    else if(pHeader->type == RECORD_ADD_CONTRIB)
+    {
+      const std::vector<float> colors = MakeColors(pHeader->passId, blockSize, W, H);
+      payloadsOk = payloadsOk && pHeader->fbWidth == uint32_t(W) && pHeader->fbHeight == uint32_t(H) &&
+                   pHeader->payloadBytes == colors.size()*sizeof(float) && std::memcmp(pPayload, colors.data(), colors.size()*sizeof(float)) == 0;
+    }
+    else if(pHeader->type == RECORD_FRAMEBUFFER)
+      payloadsOk = payloadsOk && pHeader->payloadBytes == uint64_t(W*H*4)*sizeof(float) && pHeader->fbWidth == uint32_t(W);
+    else if(pHeader->type == RECORD_IMAGE)
+    {
+      bool same = (pHeader->payloadBytes == uint64_t(W*H)*sizeof(uint32_t));
+      for(int i=0; i<W*H && same; i++)
+        same = (((const uint32_t*)pPayload)[i] == uint32_t(size_t(i)*2654435761u));
+      payloadsOk = payloadsOk && same;
+    }
+    recordId++;
+  }
+
+  log.Expect(recordId == expected.size(), "file has " + std::to_string(recordId) + " records, expected " + std::to_string(expected.size()));
+  log.Expect(payloadsOk, "payloads differ from plugin calls");
+  reader.Close();
+  std::remove(path);
+
+  return log.Report();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int CheckCompensatedAccum(const std::vector<const HostKernels*>& a_kernels)
+{
+  CheckLog log("compensated accumulation");
+
+  // many small samples into few rows: plain float framebuffer loses low bits long before 1M samples per pixel
+  //
+  const int W = 67, H = 32, blockSize = 2000, blocksNum = 4000;
+  std::vector<float> first;
+  for(auto pKernels : a_kernels)
+  {
+    const std::string what = pKernels->name;
+    CompensatedAccum accum;
+    accum.enabled = true;
+    std::vector<float>  framebuffer(W*H*4, 0.0f);
+    std::vector<double> reference(W*H*4, 0.0);
+    std::vector<float>  colors(blockSize*4);
+
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int>    px(0, W-1), py(4, 9);
+    std::uniform_real_distribution<float> rnd(0.0f, 1.0f);
+    double lagDiff = 0.0;
+    for(int blockId=0; blockId<blocksNum; blockId++)
+    {
+      for(int i=0;i<blockSize;i++)
+      {
+        const int x = px(gen), y = py(gen);
+        const float v = rnd(gen);
+        colors[i*4+0] = v; colors[i*4+1] = v; colors[i*4+2] = v;
+        colors[i*4+3] = as_float((i % 17 == 0) ? int(0xFFFFFFFF) : int((y << 16) | x));
+        if(i % 17 != 0)
+          reference[(y*W + x)*4] += double(v);
+      }
+      float* target = accum.BlockTarget(framebuffer.data(), W, H);
+      pKernels->AddContribution(target, colors.data(), nullptr, blockSize, W, H);
+      accum.EndBlock(pKernels, framebuffer.data(), colors.data(), blockSize, W, H);
+
+      if(blockId == 10)
+        for(int i=0;i<W*H;i++)
+          lagDiff = std::max(lagDiff, std::fabs(double(framebuffer[i*4]) - reference[i*4])/std::max(1.0, reference[i*4]));
+    }
+
+    double maxDiff = 0.0;
+    for(int i=0;i<W*H;i++)
+      maxDiff = std::max(maxDiff, std::fabs(double(framebuffer[i*4]) - reference[i*4])/std::max(1.0, reference[i*4]));
+
+    log.Expect(lagDiff < 1e-6, what + ": framebuffer is not complete after block, relative error " + std::to_string(lagDiff));
+    log.Expect(maxDiff < 1e-6, what + ": relative error " + std::to_string(maxDiff) + " against double sum");
+    log.Expect(std::count(accum.m_block.begin(), accum.m_block.end(), 0.0f) == ptrdiff_t(accum.m_block.size()), what + ": scratch buffer is not cleared by fold");
+
+    accum.Reset();
+    log.Expect(std::count(accum.m_comp.begin(), accum.m_comp.end(), 0.0f) == ptrdiff_t(accum.m_comp.size()), what + ": Reset keeps compensation");
+
+    if(first.empty())
+      first = framebuffer;
+    else
+      log.Expect(std::memcmp(first.data(), framebuffer.data(), first.size()*sizeof(float)) == 0, what + ": framebuffer differs from " + a_kernels[0]->name);
+  }
+
+  return log.Report();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+\brief inverse of OpenGL style perspective matrix, rows as in float4x4
+*/
+static float4x4 PerspectiveInverse(float a_fovY, float a_aspect, float a_near, float a_far)
+{
+  const float f   = 1.0f/std::tan(0.5f*a_fovY);
+  const float p22 = (a_far + a_near)/(a_near - a_far);
+  const float p23 = 2.0f*a_far*a_near/(a_near - a_far);
+  float4x4 m;
+  m.row[0] = float4(a_aspect/f, 0.0f, 0.0f,     0.0f);
+  m.row[1] = float4(0.0f,       1.0f/f, 0.0f,   0.0f);
+  m.row[2] = float4(0.0f,       0.0f, 0.0f,    -1.0f);
+  m.row[3] = float4(0.0f,       0.0f, 1.0f/p23, p22/p23);
+  return m;
+}
+
+/**
+\brief the same as SimpleDOF::CalcFilmBasis
+*/
+static FilmBasis FilmBasisOf(const float4x4& a_projInv, float a_fwidth, float a_fheight)
+{
+  const float ndcX0 = 1.0f/a_fwidth - 1.0f;
+  const float ndcY0 = 1.0f - 1.0f/a_fheight;
+  const float ndcDX = 2.0f/a_fwidth;
+  const float ndcDY = -2.0f/a_fheight;
+
+  FilmBasis film;
+  for(int k=0;k<4;k++)
+  {
+    const float4 row = a_projInv.row[k];
+    film.origin[k] = row.x*ndcX0 + row.y*ndcY0 + row.w;
+    film.dx[k]     = row.x*ndcDX;
+    film.dy[k]     = row.y*ndcDY;
+  }
+  return film;
+}
+
+/**
+\brief SimpleDOF::MakeRaysBlock before MakeRaysDOF kernel: scalar EyeRayDir and MapSamplesToDisc per ray
+*/
+static void MakeRaysDOFScalar(unsigned int a_table[hr_qmc::QRNG_DIMENSIONS][hr_qmc::QRNG_RESOLUTION], unsigned int a_qmcStart, float a_fwidth, float a_fheight,
+                              const float4x4& a_projInv, bool a_dof, float a_focalPlaneDist, float a_lensRadius, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, int a_blockSize)
+{
+  #pragma omp parallel for
+  for(int i=0;i<a_blockSize;i++)
+  {
+    const float rndX = hr_qmc::rndFloat(a_qmcStart+i, 0, a_table[0]);
+    const float rndY = hr_qmc::rndFloat(a_qmcStart+i, 1, a_table[0]);
+    const float x    = a_fwidth*rndX;
+    const float y    = a_fheight*rndY;
+
+    float3 ray_pos = float3(0,0,0);
+    float3 ray_dir = EyeRayDir(x, y, a_fwidth, a_fheight, a_projInv);
+    if(a_dof)
+    {
+      const float lenzX = hr_qmc::rndFloat(a_qmcStart+i, 2, a_table[0]);
+      const float lenzY = hr_qmc::rndFloat(a_qmcStart+i, 3, a_table[0]);
+      const float tFocus         = a_focalPlaneDist / (-ray_dir.z);
+      const float3 focusPosition = ray_pos + ray_dir*tFocus;
+      const float2 xy            = a_lensRadius*2.0f*MapSamplesToDisc(float2(lenzX - 0.5f, lenzY - 0.5f));
+      ray_pos.x += xy.x;
+      ray_pos.y += xy.y;
+      ray_dir = normalize(focusPosition - ray_pos);
+    }
+
+    out_rayPosAndNear[i].origin[0]   = ray_pos.x;
+    out_rayPosAndNear[i].origin[1]   = ray_pos.y;
+    out_rayPosAndNear[i].origin[2]   = ray_pos.z;
+    out_rayPosAndNear[i].xyPosPacked = packXY1616(int(x), int(y));
+    out_rayDirAndFar [i].direction[0] = ray_dir.x;
+    out_rayDirAndFar [i].direction[1] = ray_dir.y;
+    out_rayDirAndFar [i].direction[2] = ray_dir.z;
+    out_rayDirAndFar [i].dummy        = 0.0f;
+  }
+}
+
+struct DOFSetup
+{
+  DOFSetup(float a_width, float a_height) : projInv(PerspectiveInverse(0.8f, a_width/a_height, 0.01f, 100.0f))
+  {
+    hr_qmc::init(table);
+    BuildQmcBytes(&table[0][0], &qmcBytes);
+    args.qmcTable       = &table[0][0];
+    args.qmcBytes       = &qmcBytes;
+    args.qmcStart       = 12345;
+    args.fwidth         = a_width;
+    args.fheight        = a_height;
+    args.film           = FilmBasisOf(projInv, a_width, a_height);
+    args.dofEnabled     = false;
+    args.focalPlaneDist = 7.0f;
+    args.lensRadius     = 0.05f;
+    args.aperture       = &aperture;
+    args.crop           = &crop;
+  }
+
+  unsigned int  table[hr_qmc::QRNG_DIMENSIONS][hr_qmc::QRNG_RESOLUTION];
+  QmcBytes      qmcBytes;
+  float4x4      projInv;
+  ApertureShape aperture;
+  CropWindow    crop;
+  DOFRaysArgs   args;
+};
+
+static int CheckDOFRays(const std::vector<const HostKernels*>& a_kernels)
+{
+  CheckLog log("SimpleDOF rays");
+
+  const int N = 4099;
+  DOFSetup setup(640.0f, 480.0f);
+  std::vector<RayPart1> ref1(N), out1(N);
+  std::vector<RayPart2> ref2(N), out2(N);
+  std::vector<PipeThrough> pipeline(N);
+  log.Expect(setup.qmcBytes.valid, "QMC byte tables do not reproduce hr_qmc::rndFloat");
+  for(int dofAndBytes=0; dofAndBytes<4; dofAndBytes++)
+  {
+    const int dof = dofAndBytes & 1;
+    setup.args.dofEnabled = (dof == 1);
+    setup.args.qmcBytes   = (dofAndBytes < 2) ? &setup.qmcBytes : nullptr;
+    MakeRaysDOFScalar(setup.table, setup.args.qmcStart, setup.args.fwidth, setup.args.fheight, setup.projInv, setup.args.dofEnabled,
+                      setup.args.focalPlaneDist, setup.args.lensRadius, ref1.data(), ref2.data(), N);
+    for(auto pKernels : a_kernels)
+    {
+      pKernels->MakeRaysDOF(setup.args, out1.data(), out2.data(), pipeline.data(), N);
+      float maxDiff = 0.0f;
+      int   pixelsDiffer = 0;
+      for(int i=0;i<N;i++)
+      {
+        for(int k=0;k<3;k++)
+          maxDiff = std::max(maxDiff, std::max(std::fabs(out1[i].origin[k] - ref1[i].origin[k]), std::fabs(out2[i].direction[k] - ref2[i].direction[k])));
+        pixelsDiffer += (out1[i].xyPosPacked != ref1[i].xyPosPacked || pipeline[i].packedIndex != ref1[i].xyPosPacked) ? 1 : 0;
+      }
+      const std::string what = std::string(pKernels->name) + (dof ? " thin lens" : " pinhole") + (setup.args.qmcBytes ? "" : ", hr_qmc::rndFloat");
+      log.Expect(pixelsDiffer == 0, what + ": " + std::to_string(pixelsDiffer) + " rays have other pixel than scalar EyeRayDir");
+      log.Expect(maxDiff < 1e-5f, what + ": rays differ from scalar EyeRayDir by " + std::to_string(maxDiff));
+    }
+  }
+
+  return log.Report();
+}
+
+static void BenchDOFRays(const std::vector<const HostKernels*>& a_kernels, int a_blockSize, int a_repeat)
+{
+  DOFSetup setup(1920.0f, 1080.0f);
+  std::vector<RayPart1> part1(a_blockSize);
+  std::vector<RayPart2> part2(a_blockSize);
+  std::vector<PipeThrough> pipeline(a_blockSize);
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "[hydra_cam_checks]: SimpleDOF rays, block of " << a_blockSize << " rays, best of " << a_repeat << " blocks" << std::endl;
+  for(int dof=0; dof<2; dof++)
+  {
+    setup.args.dofEnabled = (dof == 1);
+    std::cout << (dof ? "  thin lens" : "  pinhole") << std::endl;
+    for(int run=-1; run<2*int(a_kernels.size()); run++)
+    {
+      const int kernelId = (run < 0) ? -1 : run % int(a_kernels.size());
+      setup.args.qmcBytes = (run < int(a_kernels.size())) ? &setup.qmcBytes : nullptr;
+      double bestMs = 1e30;
+      for(int iter=0; iter<a_repeat; iter++)
+      {
+        const auto before = std::chrono::high_resolution_clock::now();
+        if(kernelId < 0)
+          MakeRaysDOFScalar(setup.table, setup.args.qmcStart, setup.args.fwidth, setup.args.fheight, setup.projInv, setup.args.dofEnabled,
+                            setup.args.focalPlaneDist, setup.args.lensRadius, part1.data(), part2.data(), a_blockSize);
+        else
+          a_kernels[kernelId]->MakeRaysDOF(setup.args, part1.data(), part2.data(), pipeline.data(), a_blockSize);
+        const auto after = std::chrono::high_resolution_clock::now();
+        bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(after - before).count());
+        setup.args.qmcStart += unsigned(a_blockSize);
+      }
+      const std::string name = (kernelId < 0) ? std::string("scalar EyeRayDir") : std::string(a_kernels[kernelId]->name) + (setup.args.qmcBytes ? "" : ", rndFloat");
+      std::cout << "    " << std::left << std::setw(18) << name.c_str() << std::right << ": " << bestMs << " ms, "
+                << double(a_blockSize)/(1000.0*bestMs) << " Mrays/s" << std::endl;
+    }
+  }
+}
+
+int main(int argc, const char** argv)
+{
+  const std::vector<const HostKernels*> kernels = SupportedKernels();
+
+  if(argc > 1 && std::strcmp(argv[1], "-bench") == 0)
+  {
+    const int blockSize = (argc > 2) ? std::max(1, std::atoi(argv[2])) : 1024*512;
+    const int repeat    = (argc > 3) ? std::max(1, std::atoi(argv[3])) : 10;
+    BenchDOFRays(kernels, blockSize, repeat);
+    return 0;
+  }
+
+  int failed = 0;
+  failed += CheckLensSolve();
+  failed += CheckSortRays(kernels);
+  failed += CheckApertureSampling();
+  failed += CheckPartialMerge(kernels[0]);
+  failed += CheckRecordRoundTrip();
+  failed += CheckCompensatedAccum(kernels);
+  failed += CheckDOFRays(kernels);
+
+  std::cout << "[hydra_cam_checks]: " << failed << " checks failed" << std::endl;
+  return failed;
+}
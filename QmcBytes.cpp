@@ -0,0 +1,67 @@
+#include "QmcBytes.h"
+
+#include "../HydraAPI/hydra_api/HydraAPI.h" // for hr_qmc
+
+#include <iostream>
+#include <cstring>
+
+static bool SameBits(float a, float b) { return memcmp(&a, &b, sizeof(float)) == 0; }
+
+static bool ReproducesRndFloat(const QmcBytes* a_qmc, const unsigned int* a_table)
+{
+  unsigned int* table = (unsigned int*)a_table;
+
+  // every single bit of index, then mixed indices; XOR is linear, so wrong byte tables or offset fail on few of them
+  //
+  for(int dim=0; dim<QMC_BYTE_DIMS; dim++)
+  {
+    for(int bit=0; bit<32; bit++)
+    {
+      const unsigned int index = 1u << bit;
+      if(!SameBits(QmcBytesFloat(a_qmc, index, dim), hr_qmc::rndFloat(index, dim, table)))
+        return false;
+    }
+
+    unsigned int index = 0;
+    for(int i=0; i<4096; i++, index = index*1664525u + 1013904223u)
+    {
+      if(!SameBits(QmcBytesFloat(a_qmc, index, dim), hr_qmc::rndFloat(index, dim, table)))
+        return false;
+    }
+  }
+  return true;
+}
+
+void BuildQmcBytes(const unsigned int* a_table, QmcBytes* out_qmc)
+{
+  for(int dim=0; dim<QMC_BYTE_DIMS; dim++)
+  {
+    const unsigned int* dirs = a_table + dim*hr_qmc::QRNG_RESOLUTION;
+    for(int k=0; k<4; k++)
+    {
+      for(uint32_t b=0; b<256; b++)
+      {
+        uint32_t point = 0;
+        for(int j=0; j<8; j++)
+        {
+          const int bit = k*8 + j;
+          if((b & (1u << j)) != 0 && bit < hr_qmc::QRNG_RESOLUTION)
+            point ^= dirs[bit];
+        }
+        out_qmc->bytes[dim][k][b] = point;
+      }
+    }
+  }
+
+  // hr_qmc of HydraAPI and of hydra_drv differ in conversion to float by (point + 1), so try both
+  //
+  out_qmc->valid = false;
+  for(uint32_t offset = 0; offset < 2 && !out_qmc->valid; offset++)
+  {
+    out_qmc->offset = offset;
+    out_qmc->valid  = ReproducesRndFloat(out_qmc, a_table);
+  }
+
+  if(!out_qmc->valid)
+    std::cout << "[BuildQmcBytes]: tables do not reproduce hr_qmc::rndFloat, it is called directly (slower ray generation)" << std::endl;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+static const int QMC_BYTE_DIMS = 5; ///<! QMC dimensions used by ray generators: film x, film y, lens x, lens y, aperture jitter
+
+/**
+  \brief hr_qmc::rndFloat with one table lookup per byte of sample index instead of 31 conditional XORs.
+
+  Sobol point is XOR of direction numbers selected by bits of index, so XOR of all numbers selected by one byte is precomputed for
+  each of 256 values. Tables are built by BuildQmcBytes from hr_qmc table and checked against hr_qmc::rndFloat; if they do not
+  reproduce it bit to bit, 'valid' is false and ray generators call hr_qmc::rndFloat as before. POD for kernels, see HostKernels.h.
+*/
+struct QmcBytes
+{
+  uint32_t bytes[QMC_BYTE_DIMS][4][256];
+  uint32_t offset; ///<! hr_qmc converts (point + offset) to float, offset is found by BuildQmcBytes
+  bool     valid;
+};
+
+static inline float QmcBytesFloat(const QmcBytes* a_qmc, unsigned int a_index, int a_dim)
+{
+  const uint32_t (*t)[256] = a_qmc->bytes[a_dim];
+  const uint32_t point = t[0][a_index & 0xFF] ^ t[1][(a_index >> 8) & 0xFF] ^ t[2][(a_index >> 16) & 0xFF] ^ t[3][(a_index >> 24) & 0x7F]; // 31 bit index
+  return float(point + a_qmc->offset)*(1.0f/2147483648.0f);
+}
+
+/**
+\brief build byte tables from hr_qmc table and verify them
+\param a_table - table[0] of hr_qmc, already initialized
+\param out_qmc - out tables; out_qmc->valid is false if they do not reproduce hr_qmc::rndFloat
+*/
+void BuildQmcBytes(const unsigned int* a_table, QmcBytes* out_qmc);
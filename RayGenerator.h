@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+
+#include "CamHostPluginAPI.h"
+#include "HostKernels.h"
+#include "HostRaysLanes.h"
+#include "CropWindow.h"
+#include "KernelMath.h"
+#include "QmcBytes.h"
+
+#include "../HydraAPI/hydra_api/HydraAPI.h" // for hr_qmc
+
+/**
+  \brief Output of camera mapping for one lane group, in camera space. Zero weight means the ray is dead (outside of image circle, blocked, ...).
+*/
+struct RayLanes
+{
+  alignas(32) float posX[RAY_LANES];
+  alignas(32) float posY[RAY_LANES];
+  alignas(32) float posZ[RAY_LANES];
+  alignas(32) float dirX[RAY_LANES];
+  alignas(32) float dirY[RAY_LANES];
+  alignas(32) float dirZ[RAY_LANES];
+  alignas(32) float weight[RAY_LANES]; ///<! goes to PipeThrough::cosPower4
+};
+
+/**
+  \brief Common part of all ray generators: QMC batching, crop window, packing of RayPart1/RayPart2 and pipeline data.
+
+  Mapping is a functor with
+
+    static constexpr bool LENS_SAMPLES;   // if true, QMC dimensions 2 and 3 are generated for lens
+    bool LensJitter() const;              // if true, QMC dimension 4 is generated too, see ApertureShape::SampleLanes
+    void operator()(const float* a_sensX, const float* a_sensY, const float* a_lensX, const float* a_lensY, const float* a_lensW, RayLanes& out_rays) const;
+
+  where all arrays have RAY_LANES size and sensor coordinates are normalized film coordinates inside crop window.
+  Mapping is called for whole lane groups so its loops may be vectorized with 'omp simd'.
+  QMC samples are taken from byte tables if a_qmcBytes is valid (it is nullptr or invalid only in custom builds of hr_qmc).
+*/
+template<typename Mapping>
+static inline void GenerateRays(const Mapping& a_mapping, const unsigned int* a_qmcTable, const QmcBytes* a_qmcBytes, unsigned int a_qmcStart, float a_fwidth, float a_fheight,
+                                const CropWindow& a_crop, RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, PipeThrough* out_pipeline, int a_blockSize)
+{
+  unsigned int* table = (unsigned int*)a_qmcTable;
+  const int groupsNum = (a_blockSize + RAY_LANES - 1)/RAY_LANES;
+  const bool lensJitter = Mapping::LENS_SAMPLES && a_mapping.LensJitter();
+  const int  usedDims   = lensJitter ? 5 : (Mapping::LENS_SAMPLES ? 4 : 2); // the rest stay 0.5
+  const bool bytesValid = (a_qmcBytes != nullptr) && a_qmcBytes->valid;
+
+  #pragma omp parallel for
+  for(int groupId=0; groupId<groupsNum; groupId++)
+  {
+    const int start = groupId*RAY_LANES;
+    const int lanes = (RAY_LANES < a_blockSize - start) ? RAY_LANES : (a_blockSize - start);
+
+    alignas(32) float sensX[RAY_LANES], sensY[RAY_LANES], lensX[RAY_LANES], lensY[RAY_LANES], lensW[RAY_LANES];
+    for(int i=0;i<RAY_LANES;i++)
+    {
+      const unsigned int qmcId = a_qmcStart + unsigned(start + ((i < lanes) ? i : lanes-1));
+      float rnd[QMC_BYTE_DIMS] = {0.5f, 0.5f, 0.5f, 0.5f, 0.5f};
+      for(int dim=0; dim<usedDims; dim++)
+        rnd[dim] = bytesValid ? QmcBytesFloat(a_qmcBytes, qmcId, dim) : hr_qmc::rndFloat(qmcId, dim, table);
+
+      sensX[i] = a_crop.minX + a_crop.sizeX*rnd[0];
+      sensY[i] = a_crop.minY + a_crop.sizeY*rnd[1];
+      lensX[i] = rnd[2];
+      lensY[i] = rnd[3];
+      lensW[i] = rnd[4];
+    }
+
+    RayLanes rays;
+    a_mapping(sensX, sensY, lensX, lensY, lensW, rays);
+
+    for(int i=0;i<lanes;i++)
+    {
+      const bool alive = (rays.weight[i] > 0.0f);
+
+      RayPart1 p1;
+      p1.origin[0]   = alive ? rays.posX[i] : 0.0f;
+      p1.origin[1]   = alive ? rays.posY[i] : -10000000.0f; // shoot dead ray under the floor
+      p1.origin[2]   = alive ? rays.posZ[i] : 0.0f;
+      p1.xyPosPacked = alive ? kmath::packXY1616(int(a_fwidth*sensX[i]), int(a_fheight*sensY[i])) : 0xFFFFFFFF;
+
+      RayPart2 p2;
+      p2.direction[0] = alive ? rays.dirX[i] : 0.0f;
+      p2.direction[1] = alive ? rays.dirY[i] : -1.0f;
+      p2.direction[2] = alive ? rays.dirZ[i] : 0.0f;
+      p2.dummy        = 0.0f;
+
+      out_rayPosAndNear[start + i] = p1;
+      out_rayDirAndFar [start + i] = p2;
+      if(out_pipeline != nullptr) // fields are written directly, PipeThrough constructor is an inline function with external linkage
+      {
+        out_pipeline[start + i].cosPower4   = rays.weight[i];
+        out_pipeline[start + i].packedIndex = p1.xyPosPacked;
+      }
+    }
+  }
+}
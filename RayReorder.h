@@ -0,0 +1,72 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+#include "HostKernels.h"
+
+std::string ws2s(const std::wstring& s);
+
+/**
+  \brief Optional reordering of generated rays for more coherent traversal on GPU. Read from <ray_sort> node of camera:
+
+    <ray_sort>octant</ray_sort>
+
+  "octant" groups rays by signs of direction, "hash" sorts them by quantized direction and then by quantized origin; default is "none".
+*/
+struct RayReorder
+{
+  void ReadFromNode(pugi::xml_node a_sortNode)
+  {
+    mode = RAY_SORT_NONE;
+    const std::wstring modeName = a_sortNode.text().as_string();
+    if(modeName == L"octant")
+      mode = RAY_SORT_OCTANT;
+    else if(modeName == L"hash")
+      mode = RAY_SORT_HASH;
+    else if(!modeName.empty() && modeName != L"none")
+      std::cout << "[RayReorder::ReadFromNode]: unknown ray_sort mode '" << ws2s(modeName).c_str() << "'" << std::endl;
+  }
+
+  /**
+  \brief sort block of rays in place; 'io_pipeline' may be null
+  */
+  void Apply(const HostKernels* a_kernels, RayPart1* io_rayPosAndNear, RayPart2* io_rayDirAndFar, PipeThrough* io_pipeline, size_t a_blockSize)
+  {
+    if(mode == RAY_SORT_NONE)
+      return;
+
+    if(keys.size() < a_blockSize)
+    {
+      keys.resize(a_blockSize);
+      keysTmp.resize(a_blockSize);
+      index.resize(a_blockSize);
+      indexTmp.resize(a_blockSize);
+      histogram.resize(RAY_SORT_CHUNKS*256);
+      part1.resize(a_blockSize);
+      part2.resize(a_blockSize);
+      pipeline.resize(a_blockSize);
+    }
+
+    RaySortArgs args;
+    args.mode        = mode;
+    args.keys        = keys.data();
+    args.keysTmp     = keysTmp.data();
+    args.index       = index.data();
+    args.indexTmp    = indexTmp.data();
+    args.histogram   = histogram.data();
+    args.tmpPart1    = part1.data();
+    args.tmpPart2    = part2.data();
+    args.tmpPipeline = pipeline.data();
+    a_kernels->SortRays(args, io_rayPosAndNear, io_rayDirAndFar, io_pipeline, int(a_blockSize));
+  }
+
+  RAY_SORT_MODE mode = RAY_SORT_NONE;
+
+  std::vector<uint32_t>    keys, keysTmp, index, indexTmp, histogram;
+  std::vector<RayPart1>    part1;
+  std::vector<RayPart2>    part2;
+  std::vector<PipeThrough> pipeline;
+};
@@ -0,0 +1,107 @@
+#include "RaysRecord.h"
+
+#include <cstring>
+
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+bool RaysRecordReader::Open(const char* a_fileName)
+{
+  Close();
+
+#ifdef WIN32
+  HANDLE file = CreateFileA(a_fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  GetFileSizeEx(file, &size);
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if(mapping == NULL)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  m_file    = file;
+  m_mapping = mapping;
+  m_data    = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  m_size    = uint64_t(size.QuadPart);
+#else
+  const int fd = open(a_fileName, O_RDONLY);
+  if(fd < 0)
+    return false;
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // mapping keeps the file
+  if(data == MAP_FAILED)
+    return false;
+  madvise(data, size_t(st.st_size), MADV_SEQUENTIAL);
+  m_data = (const uint8_t*)data;
+  m_size = uint64_t(st.st_size);
+#endif
+
+  if(m_data == nullptr || m_size < sizeof(RecordFileHeader) || memcmp(Header()->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0 || Header()->version == 0 || Header()->version > RECORD_VERSION)
+  {
+    Close();
+    return false;
+  }
+
+  m_first  = sizeof(RecordFileHeader) + RecordPadding(Header()->textBytes);
+  m_offset = m_first;
+  return true;
+}
+
+void RaysRecordReader::Close()
+{
+#ifdef WIN32
+  if(m_data != nullptr)
+    UnmapViewOfFile(m_data);
+  if(m_mapping != nullptr)
+    CloseHandle((HANDLE)m_mapping);
+  if(m_file != nullptr)
+    CloseHandle((HANDLE)m_file);
+  m_mapping = nullptr;
+  m_file    = nullptr;
+#else
+  if(m_data != nullptr)
+    munmap((void*)m_data, size_t(m_size));
+#endif
+  m_data   = nullptr;
+  m_size   = 0;
+  m_first  = 0;
+  m_offset = 0;
+}
+
+std::string RaysRecordReader::CameraText() const
+{
+  if(m_data == nullptr)
+    return std::string();
+  return std::string((const char*)(m_data + sizeof(RecordFileHeader)), Header()->textBytes);
+}
+
+bool RaysRecordReader::Next(const RecordHeader** out_header, const uint8_t** out_payload)
+{
+  if(m_data == nullptr || m_offset + sizeof(RecordHeader) > m_size)
+    return false;
+
+  const RecordHeader* header = (const RecordHeader*)(m_data + m_offset);
+  if(m_offset + sizeof(RecordHeader) + header->payloadBytes > m_size) // capture was interrupted
+    return false;
+
+  (*out_header)  = header;
+  (*out_payload) = m_data + m_offset + sizeof(RecordHeader);
+  m_offset      += sizeof(RecordHeader) + RecordPadding(header->payloadBytes);
+  return true;
+}
+
+void RaysRecordReader::Rewind() { m_offset = m_first; }
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "CamHostPluginAPI.h"
+
+/**
+  \brief Binary format of captured plugin session. Enable capture in camera node:
+
+    <capture path="z_session.hrec" rays="1" blocks="1" />
+
+  File is RecordFileHeader, camera node text (utf8, padded to 16 bytes), then records in call order.
+  Each record is RecordHeader followed by 'payloadBytes' of data:
+    RECORD_MAKE_RAYS      - RayPart1[blockSize] and RayPart2[blockSize] produced by plugin (empty if rays="0")
+    RECORD_ADD_CONTRIB    - float4 colors[blockSize] passed to plugin
+    RECORD_FRAMEBUFFER    - float4 framebuffer[fbWidth*fbHeight] accumulated by plugin, written just before RECORD_FINISH
+    RECORD_FINISH         - no data
+    RECORD_IMAGE          - packed 8 bit RGBA image[fbWidth*fbHeight] that plugin tonemapped in FinishRendering; only if plugin exposes IFinalImageSource
+    RECORD_SET_PARAMETERS - RecordFileHeader and camera node text of the next render (padded as in file start); starts a new session
+
+  blocks="0" skips RECORD_MAKE_RAYS and RECORD_ADD_CONTRIB, so only results of each render are stored.
+  File is truncated when plugin instance opens it; later SetParameters with the same path append RECORD_SET_PARAMETERS to it.
+  Payloads are padded to 16 bytes.
+*/
+
+enum RECORD_TYPE { RECORD_MAKE_RAYS = 1, RECORD_ADD_CONTRIB = 2, RECORD_FINISH = 3, RECORD_FRAMEBUFFER = 4, RECORD_IMAGE = 5, RECORD_SET_PARAMETERS = 6 };
+
+struct RecordFileHeader
+{
+  char     magic[8];      ///<! "HCAMREC1"
+  uint32_t version;
+  int32_t  width;         ///<! SetParameters arguments
+  int32_t  height;        ///<!
+  uint32_t textBytes;     ///<! camera node text size without padding
+  float    projInv[16];   ///<!
+  uint64_t reserved;
+};
+
+struct RecordHeader
+{
+  uint32_t type;          ///<! RECORD_TYPE
+  int32_t  passId;
+  uint32_t blockSize;
+  uint32_t fbWidth;       ///<! AddSamplesContribution a_width
+  uint32_t fbHeight;      ///<! AddSamplesContribution a_height
+  uint32_t reserved;
+  uint64_t payloadBytes;
+};
+
+static const char     RECORD_MAGIC[8] = {'H','C','A','M','R','E','C','1'};
+static const uint32_t RECORD_VERSION  = 2; ///<! version 1 files have no RECORD_SET_PARAMETERS and are read as is
+
+static inline uint64_t RecordPadding(uint64_t a_size) { return (a_size + 15) & ~uint64_t(15); }
+
+/**
+  \brief Memory mapped read-only view of captured session
+*/
+class RaysRecordReader
+{
+public:
+  RaysRecordReader() = default;
+  ~RaysRecordReader() { Close(); }
+
+  RaysRecordReader(const RaysRecordReader&)            = delete;
+  RaysRecordReader& operator=(const RaysRecordReader&) = delete;
+
+  bool Open(const char* a_fileName);
+  void Close();
+
+  const RecordFileHeader* Header()     const { return (const RecordFileHeader*)m_data; }
+  std::string             CameraText() const;
+
+  /**
+  \brief get next record; returns false at the end of file or if the rest of file is truncated
+  \param out_header  - record header
+  \param out_payload - record data, 'out_header->payloadBytes' size
+  */
+  bool Next(const RecordHeader** out_header, const uint8_t** out_payload);
+  void Rewind();
+
+protected:
+
+  const uint8_t* m_data   = nullptr;
+  uint64_t       m_size   = 0;
+  uint64_t       m_first  = 0; ///<! offset of the first record
+  uint64_t       m_offset = 0; ///<! offset of the next record
+
+#ifdef WIN32
+  void* m_file    = nullptr;
+  void* m_mapping = nullptr;
+#endif
+};
+
+/**
+  \brief Plugin that can give its tonemapped image to recorder after FinishRendering
+*/
+struct IFinalImageSource
+{
+  virtual ~IFinalImageSource() = default;
+
+  /**
+  \brief packed 8 bit RGBA image of the last FinishRendering, width*height of AddSamplesContribution; empty if there is none
+  */
+  virtual const std::vector<uint32_t>& FinalImage() const = 0;
+};
+
+/**
+  \brief Wrap plugin implementation to capture its inputs and outputs if camera node has <capture> child; otherwise calls are passed through.
+  \param a_impl  - plugin; recorder owns it
+  \param a_image - source of RECORD_IMAGE, usually the same object as 'a_impl'; nullptr if plugin has no final image
+*/
+IHostRaysAPI* MakeRaysRecorder(IHostRaysAPI* a_impl, const IFinalImageSource* a_image = nullptr);
@@ -0,0 +1,196 @@
+#include "RaysRecord.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+
+std::string ws2s(const std::wstring& s);
+
+class RaysRecorder : public IHostRaysAPI
+{
+public:
+  RaysRecorder(IHostRaysAPI* a_impl, const IFinalImageSource* a_image) : m_impl(a_impl), m_image(a_image) {}
+  ~RaysRecorder() override { CloseFile(); }
+
+  void SetParameters(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText) override
+  {
+    m_impl->SetParameters(a_width, a_height, a_projInvMatrix, a_camNodeText);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    BeginSession(a_width, a_height, a_projInvMatrix, a_camNodeText);
+    m_lastFbPointer = nullptr;
+  }
+
+  void MakeRaysBlock(RayPart1* out_rayPosAndNear, RayPart2* out_rayDirAndFar, size_t in_blockSize, int passId) override
+  {
+    m_impl->MakeRaysBlock(out_rayPosAndNear, out_rayDirAndFar, in_blockSize, passId);
+    if(m_file == nullptr || !m_saveBlocks)
+      return;
+
+    const uint64_t raysBytes = m_saveRays ? uint64_t(in_blockSize)*(sizeof(RayPart1) + sizeof(RayPart2)) : 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    WriteHeader(RECORD_MAKE_RAYS, passId, in_blockSize, 0, 0, raysBytes);
+    if(m_saveRays)
+    {
+      fwrite(out_rayPosAndNear, sizeof(RayPart1), in_blockSize, m_file);
+      fwrite(out_rayDirAndFar,  sizeof(RayPart2), in_blockSize, m_file);
+    }
+  }
+
+  void AddSamplesContribution(float* out_color4f, const float* colors4f, size_t in_blockSize, uint32_t a_width, uint32_t a_height, int passId) override
+  {
+    if(m_file != nullptr && m_saveBlocks)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      WriteHeader(RECORD_ADD_CONTRIB, passId, in_blockSize, a_width, a_height, uint64_t(in_blockSize)*sizeof(float)*4);
+      fwrite(colors4f, sizeof(float)*4, in_blockSize, m_file);
+    }
+    m_impl->AddSamplesContribution(out_color4f, colors4f, in_blockSize, a_width, a_height, passId);
+    m_lastFbPointer = out_color4f;
+    m_fbWidth       = a_width;
+    m_fbHeight      = a_height;
+  }
+
+  void FinishRendering() override
+  {
+    if(m_file != nullptr)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if(m_lastFbPointer != nullptr)
+      {
+        const uint64_t fbBytes = uint64_t(m_fbWidth)*uint64_t(m_fbHeight)*sizeof(float)*4;
+        WriteHeader(RECORD_FRAMEBUFFER, 0, 0, m_fbWidth, m_fbHeight, fbBytes);
+        fwrite(m_lastFbPointer, 1, size_t(fbBytes), m_file);
+      }
+      WriteHeader(RECORD_FINISH, 0, 0, 0, 0, 0);
+    }
+
+    m_impl->FinishRendering();
+
+    // final image goes after FinishRendering; replay compares it with the image of its own capture
+    //
+    if(m_file != nullptr && m_image != nullptr && !m_image->FinalImage().empty() && m_image->FinalImage().size() == size_t(m_fbWidth)*size_t(m_fbHeight))
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      const std::vector<uint32_t>& image = m_image->FinalImage();
+      const uint64_t imageBytes = uint64_t(image.size())*sizeof(uint32_t);
+      WriteHeader(RECORD_IMAGE, 0, 0, m_fbWidth, m_fbHeight, imageBytes);
+      fwrite(image.data(), 1, size_t(imageBytes), m_file);
+      WritePadding(imageBytes);
+    }
+    if(m_file != nullptr)
+      fflush(m_file); // file stays open for the next SetParameters, but finished session must be readable
+    m_lastFbPointer = nullptr;
+  }
+
+protected:
+
+  void BeginSession(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText);
+  void CloseFile();
+  void WriteHeader(RECORD_TYPE a_type, int a_passId, size_t a_blockSize, uint32_t a_fbWidth, uint32_t a_fbHeight, uint64_t a_payloadBytes);
+  void WritePadding(uint64_t a_payloadBytes);
+
+  std::unique_ptr<IHostRaysAPI> m_impl;
+  const IFinalImageSource*      m_image = nullptr;
+
+  FILE*       m_file       = nullptr;
+  std::string m_path;                ///<! path of opened file; the same path in the next SetParameters appends a session
+  bool        m_saveRays   = true;
+  bool        m_saveBlocks = true;
+  std::mutex  m_mutex;               ///<! MakeRaysBlock and AddSamplesContribution may be called from different threads
+
+  const float* m_lastFbPointer = nullptr; ///<! framebuffer of the last AddSamplesContribution, saved in FinishRendering
+  uint32_t     m_fbWidth       = 0;
+  uint32_t     m_fbHeight      = 0;
+};
+
+void RaysRecorder::BeginSession(int a_width, int a_height, const float a_projInvMatrix[16], const wchar_t* a_camNodeText)
+{
+  pugi::xml_document doc;
+  doc.load_string(a_camNodeText);
+  pugi::xml_node camNode = doc.child(L"camera");
+  pugi::xml_node capture = camNode.child(L"capture");
+  if(capture == nullptr)
+  {
+    CloseFile();
+    return;
+  }
+
+  const std::string path = ws2s(capture.attribute(L"path").as_string(L"z_session.hrec"));
+  m_saveRays   = capture.attribute(L"rays").as_bool(true);
+  m_saveBlocks = capture.attribute(L"blocks").as_bool(true);
+
+  // store camera node without <capture>, so replay does not overwrite the file it reads
+  //
+  camNode.remove_child(L"capture");
+  std::wstringstream strOut;
+  doc.print(strOut);
+  const std::string text = ws2s(strOut.str());
+
+  RecordFileHeader header;
+  memset(&header, 0, sizeof(RecordFileHeader));
+  memcpy(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+  header.version   = RECORD_VERSION;
+  header.width     = a_width;
+  header.height    = a_height;
+  header.textBytes = uint32_t(text.size());
+  memcpy(header.projInv, a_projInvMatrix, sizeof(header.projInv));
+
+  if(m_file != nullptr && path == m_path) // next render of the same plugin instance
+  {
+    WriteHeader(RECORD_SET_PARAMETERS, 0, 0, 0, 0, sizeof(RecordFileHeader) + RecordPadding(text.size()));
+  }
+  else
+  {
+    CloseFile();
+    m_file = fopen(path.c_str(), "wb");
+    if(m_file == nullptr)
+    {
+      std::cout << "[RaysRecorder::BeginSession]: can't open capture file " << path.c_str() << std::endl;
+      return;
+    }
+    setvbuf(m_file, nullptr, _IOFBF, 4*1024*1024);
+    m_path = path;
+    std::cout << "[RaysRecorder::BeginSession]: capture session to " << path.c_str() << std::endl;
+  }
+
+  const char zeros[16] = {};
+  fwrite(&header, sizeof(RecordFileHeader), 1, m_file);
+  fwrite(text.data(), 1, text.size(), m_file);
+  fwrite(zeros, 1, RecordPadding(text.size()) - text.size(), m_file);
+}
+
+void RaysRecorder::CloseFile()
+{
+  if(m_file != nullptr)
+    fclose(m_file);
+  m_file = nullptr;
+  m_path.clear();
+}
+
+void RaysRecorder::WriteHeader(RECORD_TYPE a_type, int a_passId, size_t a_blockSize, uint32_t a_fbWidth, uint32_t a_fbHeight, uint64_t a_payloadBytes)
+{
+  RecordHeader header;
+  header.type         = uint32_t(a_type);
+  header.passId       = a_passId;
+  header.blockSize    = uint32_t(a_blockSize);
+  header.fbWidth      = a_fbWidth;
+  header.fbHeight     = a_fbHeight;
+  header.reserved     = 0;
+  header.payloadBytes = a_payloadBytes;
+  fwrite(&header, sizeof(RecordHeader), 1, m_file);
+}
+
+void RaysRecorder::WritePadding(uint64_t a_payloadBytes)
+{
+  // rays, colors and framebuffer are arrays of 16 byte structs and need no padding; packed image may need it
+  //
+  const char zeros[16] = {};
+  fwrite(zeros, 1, size_t(RecordPadding(a_payloadBytes) - a_payloadBytes), m_file);
+}
+
+IHostRaysAPI* MakeRaysRecorder(IHostRaysAPI* a_impl, const IFinalImageSource* a_image) { return (a_impl == nullptr) ? nullptr : new RaysRecorder(a_impl, a_image); }
@@ -0,0 +1,321 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <codecvt>
+#include <locale>
+#include <sstream>
+#include <cstdio>
+#include <utility>
+
+#include "CamHostPluginAPI.h"
+#include "RaysRecord.h"
+#include "../HydraAPI/hydra_api/pugixml.hpp" // for XML
+
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <dlfcn.h>
+#endif
+
+/**
+  \brief Feed captured session back into any plugin build, on CPU only.
+
+    hydra_cam_replay -plugin ./libhydra_cam_plugin.so -id 2 -in z_session.hrec [-repeat 4] [-out z_session.hrec.replay] [-check]
+
+  MakeRaysBlock and AddSamplesContribution are called in recorded order with recorded block sizes and colors;
+  generated rays are compared against recorded ones if the session was captured with rays="1",
+  accumulated framebuffer and final image are compared against recorded ones if they are present.
+  Plugin outputs are redirected to '-out' prefix (".bmp", ".hpart" and ".hrec"), so replay never overwrites files of the captured run.
+  Final image is taken from RECORD_IMAGE of replay's own capture (<capture blocks="0"/>), i.e. exactly what plugin tonemapped in memory.
+  With '-check' exit code is 5 if anything differs from record, so a captured session is a regression test (see CMakeLists.txt).
+*/
+
+typedef IHostRaysAPI* (*MakeEmitterFunc)  (int a_pluginId);
+typedef void          (*DeleteEmitterFunc)(IHostRaysAPI* pObject);
+
+static std::wstring utf8_to_ws(const std::string& str)
+{
+  std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> converterX;
+  return converterX.from_bytes(str);
+}
+
+struct ReplayStat
+{
+  double   raysMs     = 0.0;
+  double   contribMs  = 0.0;
+  double   finishMs   = 0.0;
+  uint64_t rays       = 0;
+  uint64_t samples    = 0;
+  uint64_t raysDiffer = 0;
+  float    maxDiff    = 0.0f;
+
+  bool     fbCompared    = false;
+  uint64_t fbDiffer      = 0;    ///<! framebuffer floats with relative difference above 1e-5
+  float    fbMaxDiff     = 0.0f; ///<! relative
+  bool     imageCompared = false;
+  uint64_t imageDiffer   = 0;    ///<! pixels with any channel different by more than 1
+  int      imageMaxDiff  = 0;
+};
+
+static std::wstring RedirectOutputs(const std::string& a_camText, const std::string& a_outPrefix)
+{
+  pugi::xml_document doc;
+  doc.load_string(utf8_to_ws(a_camText).c_str());
+  pugi::xml_node camNode = doc.child(L"camera");
+
+  pugi::xml_node output = camNode.child(L"output");
+  if(output == nullptr)
+    output = camNode.append_child(L"output");
+  output.remove_attribute(L"image");
+  output.append_attribute(L"image") = utf8_to_ws(a_outPrefix + ".bmp").c_str();
+
+  pugi::xml_node distr = camNode.child(L"distributed");
+  if(distr.attribute(L"partial_output") != nullptr)
+    distr.attribute(L"partial_output") = utf8_to_ws(a_outPrefix + ".hpart").c_str();
+
+  // results only; final images of this capture are compared with recorded ones
+  //
+  camNode.remove_child(L"capture");
+  pugi::xml_node capture = camNode.append_child(L"capture");
+  capture.append_attribute(L"path")   = utf8_to_ws(a_outPrefix + ".hrec").c_str();
+  capture.append_attribute(L"rays")   = 0;
+  capture.append_attribute(L"blocks") = 0;
+
+  std::wstringstream strOut;
+  doc.print(strOut);
+  return strOut.str();
+}
+
+static void CompareFramebuffer(const std::vector<float>& a_fb, const float* a_recorded, size_t a_floatsNum, ReplayStat* pStat)
+{
+  pStat->fbCompared = true;
+  if(a_fb.size() != a_floatsNum)
+  {
+    pStat->fbDiffer = a_floatsNum;
+    return;
+  }
+  for(size_t i=0;i<a_floatsNum;i++)
+  {
+    const float diff = std::abs(a_fb[i] - a_recorded[i])/std::max(std::max(std::abs(a_fb[i]), std::abs(a_recorded[i])), 1e-6f);
+    if(diff > 1e-5f)
+      pStat->fbDiffer++;
+    pStat->fbMaxDiff = std::max(pStat->fbMaxDiff, diff);
+  }
+}
+
+static void CompareImage(const RecordHeader* a_header, const uint8_t* a_payload, const RecordHeader* a_recHeader, const uint8_t* a_recorded, ReplayStat* pStat)
+{
+  pStat->imageCompared = true;
+  const size_t pixelsNum = size_t(a_recHeader->fbWidth)*size_t(a_recHeader->fbHeight);
+  if(a_header->fbWidth != a_recHeader->fbWidth || a_header->fbHeight != a_recHeader->fbHeight)
+  {
+    pStat->imageDiffer += pixelsNum;
+    return;
+  }
+
+  const uint32_t* pixels   = (const uint32_t*)a_payload;
+  const uint32_t* recorded = (const uint32_t*)a_recorded;
+  for(size_t i=0;i<pixelsNum;i++)
+  {
+    int diff = 0;
+    for(int shift=0; shift<32; shift+=8)
+      diff = std::max(diff, std::abs(int((pixels[i] >> shift) & 0xFF) - int((recorded[i] >> shift) & 0xFF)));
+    if(diff > 1) // different ISA may round a few pixels to the neighbour value
+      pStat->imageDiffer++;
+    pStat->imageMaxDiff = std::max(pStat->imageMaxDiff, diff);
+  }
+}
+
+static void CompareRays(const RayPart1* a_p1, const RayPart2* a_p2, const uint8_t* a_recorded, size_t a_size, ReplayStat* pStat)
+{
+  const RayPart1* rec1 = (const RayPart1*)a_recorded;
+  const RayPart2* rec2 = (const RayPart2*)(a_recorded + a_size*sizeof(RayPart1));
+  for(size_t i=0;i<a_size;i++)
+  {
+    float diff = 0.0f;
+    for(int k=0;k<3;k++)
+    {
+      diff = std::max(diff, std::abs(a_p1[i].origin[k]    - rec1[i].origin[k]));
+      diff = std::max(diff, std::abs(a_p2[i].direction[k] - rec2[i].direction[k]));
+    }
+    if(diff > 1e-5f || a_p1[i].xyPosPacked != rec1[i].xyPosPacked)
+      pStat->raysDiffer++;
+    pStat->maxDiff = std::max(pStat->maxDiff, diff);
+  }
+}
+
+static bool ReplaySession(RaysRecordReader& a_reader, MakeEmitterFunc a_make, DeleteEmitterFunc a_delete, int a_pluginId, const std::string& a_outPrefix, ReplayStat* pStat)
+{
+  IHostRaysAPI* pPlugin = a_make(a_pluginId);
+  if(pPlugin == nullptr)
+    return false;
+
+  const RecordFileHeader* fileHeader = a_reader.Header();
+  const std::wstring camText = RedirectOutputs(a_reader.CameraText(), a_outPrefix);
+  pPlugin->SetParameters(fileHeader->width, fileHeader->height, fileHeader->projInv, camText.c_str());
+
+  std::vector<RayPart1> rays1;
+  std::vector<RayPart2> rays2;
+  std::vector<float>    framebuffer;
+  std::vector<std::pair<const RecordHeader*, const uint8_t*> > images; // recorded RECORD_IMAGE in session order
+
+  a_reader.Rewind();
+  const RecordHeader* header  = nullptr;
+  const uint8_t*      payload = nullptr;
+  while(a_reader.Next(&header, &payload))
+  {
+    const auto start = std::chrono::high_resolution_clock::now();
+    if(header->type == RECORD_SET_PARAMETERS)
+    {
+      const RecordFileHeader* params = (const RecordFileHeader*)payload;
+      const std::wstring nextText    = RedirectOutputs(std::string((const char*)(payload + sizeof(RecordFileHeader)), params->textBytes), a_outPrefix);
+      pPlugin->SetParameters(params->width, params->height, params->projInv, nextText.c_str());
+      framebuffer.clear(); // Hydra clears framebuffer for each render
+    }
+    else if(header->type == RECORD_MAKE_RAYS)
+    {
+      if(rays1.size() < header->blockSize)
+      {
+        rays1.resize(header->blockSize);
+        rays2.resize(header->blockSize);
+      }
+      pPlugin->MakeRaysBlock(rays1.data(), rays2.data(), header->blockSize, header->passId);
+      pStat->raysMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+      pStat->rays   += header->blockSize;
+      if(header->payloadBytes != 0)
+        CompareRays(rays1.data(), rays2.data(), payload, header->blockSize, pStat);
+    }
+    else if(header->type == RECORD_ADD_CONTRIB)
+    {
+      if(framebuffer.empty())
+        framebuffer.resize(size_t(header->fbWidth)*size_t(header->fbHeight)*4, 0.0f);
+      const auto startContrib = std::chrono::high_resolution_clock::now();
+      pPlugin->AddSamplesContribution(framebuffer.data(), (const float*)payload, header->blockSize, header->fbWidth, header->fbHeight, header->passId);
+      pStat->contribMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startContrib).count();
+      pStat->samples   += header->blockSize;
+    }
+    else if(header->type == RECORD_FINISH)
+    {
+      pPlugin->FinishRendering();
+      pStat->finishMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+    else if(header->type == RECORD_FRAMEBUFFER)
+      CompareFramebuffer(framebuffer, (const float*)payload, size_t(header->fbWidth)*size_t(header->fbHeight)*4, pStat);
+    else if(header->type == RECORD_IMAGE)
+      images.push_back(std::make_pair(header, payload));
+  }
+
+  a_delete(pPlugin); // closes replay capture
+
+  if(!images.empty())
+  {
+    RaysRecordReader replayed;
+    size_t imageId = 0;
+    if(replayed.Open((a_outPrefix + ".hrec").c_str()))
+    {
+      while(replayed.Next(&header, &payload))
+      {
+        if(header->type == RECORD_IMAGE && imageId < images.size())
+        {
+          CompareImage(header, payload, images[imageId].first, images[imageId].second, pStat);
+          imageId++;
+        }
+      }
+    }
+    if(imageId != images.size())
+      std::cout << "[hydra_cam_replay]: plugin gave " << imageId << " of " << images.size() << " recorded final images, the rest is not compared" << std::endl;
+  }
+
+  return true;
+}
+
+int main(int argc, const char** argv)
+{
+  std::string pluginPath, inputPath, outPrefix;
+  int pluginId = 1;
+  int repeat   = 1;
+  bool check   = false;
+  for(int i=1;i<argc;i++)
+  {
+    if(std::strcmp(argv[i], "-check") == 0)
+      check = true;
+    else if(i+1 == argc) // the rest of options have a value
+      break;
+    else if(std::strcmp(argv[i], "-plugin") == 0)
+      pluginPath = argv[++i];
+    else if(std::strcmp(argv[i], "-in") == 0)
+      inputPath = argv[++i];
+    else if(std::strcmp(argv[i], "-id") == 0)
+      pluginId = std::atoi(argv[++i]);
+    else if(std::strcmp(argv[i], "-repeat") == 0)
+      repeat = std::max(1, std::atoi(argv[++i]));
+    else if(std::strcmp(argv[i], "-out") == 0)
+      outPrefix = argv[++i];
+  }
+
+  if(pluginPath.empty() || inputPath.empty())
+  {
+    std::cout << "usage: hydra_cam_replay -plugin libhydra_cam_plugin.so -id 2 -in z_session.hrec [-repeat 4] [-out z_session.hrec.replay] [-check]" << std::endl;
+    return 1;
+  }
+  if(outPrefix.empty())
+    outPrefix = inputPath + ".replay";
+
+#ifdef WIN32
+  HMODULE lib = LoadLibraryA(pluginPath.c_str());
+  MakeEmitterFunc   makeFunc   = lib ? (MakeEmitterFunc)  GetProcAddress(lib, "MakeHostRaysEmitter") : nullptr;
+  DeleteEmitterFunc deleteFunc = lib ? (DeleteEmitterFunc)GetProcAddress(lib, "DeleteRaysEmitter")   : nullptr;
+#else
+  void* lib = dlopen(pluginPath.c_str(), RTLD_NOW);
+  MakeEmitterFunc   makeFunc   = lib ? (MakeEmitterFunc)  dlsym(lib, "MakeHostRaysEmitter") : nullptr;
+  DeleteEmitterFunc deleteFunc = lib ? (DeleteEmitterFunc)dlsym(lib, "DeleteRaysEmitter")   : nullptr;
+#endif
+  if(makeFunc == nullptr || deleteFunc == nullptr)
+  {
+    std::cout << "[hydra_cam_replay]: can't load plugin " << pluginPath.c_str() << std::endl;
+    return 2;
+  }
+
+  RaysRecordReader reader;
+  if(!reader.Open(inputPath.c_str()))
+  {
+    std::cout << "[hydra_cam_replay]: can't open session " << inputPath.c_str() << std::endl;
+    return 3;
+  }
+
+  bool differs = false;
+  for(int iter=0; iter<repeat; iter++)
+  {
+    ReplayStat stat;
+    if(!ReplaySession(reader, makeFunc, deleteFunc, pluginId, outPrefix, &stat))
+    {
+      std::cout << "[hydra_cam_replay]: plugin #" << pluginId << " was not created" << std::endl;
+      return 4;
+    }
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[hydra_cam_replay]: run " << iter << std::endl;
+    std::cout << "  MakeRaysBlock          : " << stat.raysMs    << " ms, " << double(stat.rays)   /(1000.0*std::max(stat.raysMs,    1e-6)) << " Mrays/s" << std::endl;
+    std::cout << "  AddSamplesContribution : " << stat.contribMs << " ms, " << double(stat.samples)/(1000.0*std::max(stat.contribMs, 1e-6)) << " Msamples/s" << std::endl;
+    std::cout << "  FinishRendering        : " << stat.finishMs  << " ms" << std::endl;
+    std::cout << "  rays differ from record: " << stat.raysDiffer << ", max diff = " << std::scientific << stat.maxDiff << std::endl;
+    if(stat.fbCompared)
+      std::cout << "  framebuffer differs    : " << stat.fbDiffer << " floats, max relative diff = " << stat.fbMaxDiff << std::endl;
+    if(stat.imageCompared)
+      std::cout << "  final image differs    : " << stat.imageDiffer << " pixels, max channel diff = " << stat.imageMaxDiff << std::endl;
+    differs = differs || (stat.raysDiffer != 0) || (stat.fbDiffer != 0) || (stat.imageDiffer != 0);
+  }
+
+  if(check && differs)
+  {
+    std::cout << "[hydra_cam_replay]: replay differs from record" << std::endl;
+    return 5;
+  }
+  return 0;
+}
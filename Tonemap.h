@@ -0,0 +1,61 @@
+#pragma once
+
+#include <math.h>
+#include <cstdint>
+
+/**
+\brief clamp color to [0,1] and pack it to 8 bit RGBA, red in the lowest byte; the same layout as RealColorToUint32 of cglobals.h,
+       which is not used here because this header is compiled into kernels of every instruction set (see HostKernels.h)
+*/
+static inline uint32_t PackColorRGBA8(float r, float g, float b, float a)
+{
+  r = fminf(fmaxf(r, 0.0f), 1.0f);
+  g = fminf(fmaxf(g, 0.0f), 1.0f);
+  b = fminf(fmaxf(b, 0.0f), 1.0f);
+  a = fminf(fmaxf(a, 0.0f), 1.0f);
+  return uint32_t(r*255.0f) | (uint32_t(g*255.0f) << 8) | (uint32_t(b*255.0f) << 16) | (uint32_t(a*255.0f) << 24);
+}
+
+/**
+\brief normalize accumulated float4 colors, apply gamma 2.2 and convert them to packed 8 bit RGBA
+\param a_color4f   - in  accumulated float4 image
+\param out_pixels  - out packed pixels
+\param a_pixelsNum - number of pixels
+\param a_normConst - normalization constant, usually 1/spp
+*/
+static inline void ToneMapPixels(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst)
+{
+  const float invGamma = 1.0f/2.2f;
+
+  #pragma omp parallel for
+  for(int i=0;i<a_pixelsNum;i++)
+  {
+    const float* color = a_color4f + size_t(i)*4;
+    out_pixels[i] = PackColorRGBA8(powf(color[0]*a_normConst, invGamma),
+                                   powf(color[1]*a_normConst, invGamma),
+                                   powf(color[2]*a_normConst, invGamma), 1.0f);
+  }
+}
+
+static inline float FilmicACES(float x)
+{
+  x = fmaxf(x, 0.0f);
+  return (x*(2.51f*x + 0.03f))/(x*(2.43f*x + 0.59f) + 0.14f);
+}
+
+/**
+\brief the same as ToneMapPixels, but with filmic curve (Narkowicz fit of ACES) before gamma; 'a_normConst' may include exposure
+*/
+static inline void ToneMapPixelsFilmic(const float* a_color4f, uint32_t* out_pixels, int a_pixelsNum, float a_normConst)
+{
+  const float invGamma = 1.0f/2.2f;
+
+  #pragma omp parallel for
+  for(int i=0;i<a_pixelsNum;i++)
+  {
+    const float* color = a_color4f + size_t(i)*4;
+    out_pixels[i] = PackColorRGBA8(powf(FilmicACES(color[0]*a_normConst), invGamma),
+                                   powf(FilmicACES(color[1]*a_normConst), invGamma),
+                                   powf(FilmicACES(color[2]*a_normConst), invGamma), 1.0f);
+  }
+}